@@ -0,0 +1,422 @@
+/*
+# File:   ai.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   21 Oct 2017
+# Descr:  Computer opponent, played on this kit in place of the other kit. It keeps a count for every cell
+#         of the ways the player's ships still afloat could lie across it, and fires at the cell most likely
+#         to hold a ship. The counts are updated around each shot rather than worked out again for the whole board
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include "system.h"
+#include "ircomms.h"
+#include "irframe.h"
+#include "game.h"
+#include "bitboard.h"
+#include "profile.h"
+#include "ai.h"
+
+// Game ticks the computer waits before firing, so the player sees it is their turn to wait
+#define AI_THINK_TICKS (GAME_TICK_RATE / 2)
+
+static bool ai_active = 0;
+static uint16_t random_state = 1;
+
+// The computer's own fleet and how many of its ships have been sunk
+static PlayerShip ai_ships[SHIPS_COUNT];
+static uint8_t ai_ships_lost = 0;
+
+// The computer's shots at the player. Blocked cells can't hold a ship still afloat, they are misses and the cells
+// of sunk ships. Open hits are hits on ships that haven't been sunk yet
+static bitboard_t shot_board;
+static bitboard_t blocked_board;
+static bitboard_t open_hits_board;
+
+// Lengths of the player's ships, 0 once the ship has been sunk
+static uint8_t afloat[SHIPS_COUNT];
+
+// Ways the player's ships still afloat could lie across each cell without crossing a blocked cell
+static uint8_t density[LEDMAT_COLS_NUM][LEDMAT_ROWS_NUM];
+
+// The same counts for only the places that also cover an open hit, used while a hit ship is still afloat
+static uint8_t target[LEDMAT_COLS_NUM][LEDMAT_ROWS_NUM];
+
+// Packet waiting for the inbound slot to be free
+static ir_packet_t outbox_type;
+static uint8_t outbox_payload[IRFRAME_PAYLOAD_MAX];
+static uint8_t outbox_length = 0;
+static bool outbox_full = 0;
+
+// The computer fires after answering the player's shot, once it has thought for AI_THINK_TICKS
+static bool ai_turn = 0;
+static bool ai_thinking = 0;
+static uint8_t think_ticks = 0;
+
+// Xorshift random numbers, seeded from the free running timer when the computer starts
+static uint16_t ai_random (void)
+{
+    uint16_t x = random_state;
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    random_state = x;
+    return x;
+}
+
+// True if a ship length long fits at x, y without leaving the board or crossing a blocked cell
+static bool ai_fits (int8_t x, int8_t y, uint8_t length, bool vertical)
+{
+    uint8_t k;
+    if (x < 0 || y < 0) return 0;
+
+    for (k = 0; k < length; k++) {
+        uint8_t cell_x = x + (vertical ? 0 : k);
+        uint8_t cell_y = y + (vertical ? k : 0);
+        if (cell_x >= LEDMAT_ROWS_NUM || cell_y >= LEDMAT_COLS_NUM || BITBOARD_TEST (&blocked_board, cell_x, cell_y)) return 0;
+    }
+    return 1;
+}
+
+// True if a ship length long at x, y covers an open hit
+static bool ai_covers_open_hit (uint8_t x, uint8_t y, uint8_t length, bool vertical)
+{
+    uint8_t k;
+    if (!vertical) return ((open_hits_board.cols[y] >> x) & ((1 << length) - 1)) != 0;
+
+    for (k = 0; k < length; k++) {
+        if (BITBOARD_TEST (&open_hits_board, x, y + k)) return 1;
+    }
+    return 0;
+}
+
+// Adds change to the count of every cell a ship length long at x, y covers, and to the target
+// count as well if the ship covers an open hit
+static void ai_density_add (uint8_t x, uint8_t y, uint8_t length, bool vertical, int8_t change)
+{
+    bool targeted = ai_covers_open_hit (x, y, length, vertical);
+    uint8_t k;
+    for (k = 0; k < length; k++) {
+        if (vertical) {
+            density[y + k][x] += change;
+            if (targeted) target[y + k][x] += change;
+        } else {
+            density[y][x + k] += change;
+            if (targeted) target[y][x + k] += change;
+        }
+    }
+}
+
+// Adds change for every place a ship length long fits on the board as it is
+static void ai_density_add_ship (uint8_t length, int8_t change)
+{
+    bitboard_t anchors;
+    uint8_t vertical;
+    uint8_t x;
+    uint8_t y;
+
+    for (vertical = 0; vertical < 2; vertical++) {
+        bitboard_anchors (&anchors, &blocked_board, length, vertical);
+        for (y = 0; y < LEDMAT_COLS_NUM; y++) {
+            for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
+                if (BITBOARD_TEST (&anchors, x, y)) ai_density_add (x, y, length, vertical, change);
+            }
+        }
+    }
+}
+
+// Blocks x, y and takes away the places of the ships still afloat that covered it.
+// Only the few places through x, y are looked at, not the whole board
+static void ai_block (uint8_t x, uint8_t y)
+{
+    uint8_t i;
+    uint8_t k;
+    uint8_t vertical;
+
+    if (BITBOARD_TEST (&blocked_board, x, y)) return;
+
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        if (!afloat[i]) continue;
+        for (vertical = 0; vertical < 2; vertical++) {
+            for (k = 0; k < afloat[i]; k++) {
+                int8_t start_x = x - (vertical ? 0 : k);
+                int8_t start_y = y - (vertical ? k : 0);
+                if (ai_fits (start_x, start_y, afloat[i], vertical)) ai_density_add (start_x, start_y, afloat[i], vertical, -1);
+            }
+        }
+    }
+    BITBOARD_SET (&blocked_board, x, y);
+}
+
+// Opens a hit at x, y. The places through it that didn't cover an open hit already start counting as targets
+static void ai_open_hit (uint8_t x, uint8_t y)
+{
+    uint8_t i;
+    uint8_t k;
+    uint8_t j;
+    uint8_t vertical;
+
+    if (BITBOARD_TEST (&open_hits_board, x, y)) return;
+
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        if (!afloat[i]) continue;
+        for (vertical = 0; vertical < 2; vertical++) {
+            for (k = 0; k < afloat[i]; k++) {
+                int8_t start_x = x - (vertical ? 0 : k);
+                int8_t start_y = y - (vertical ? k : 0);
+                if (!ai_fits (start_x, start_y, afloat[i], vertical)) continue;
+                if (ai_covers_open_hit (start_x, start_y, afloat[i], vertical)) continue;
+                for (j = 0; j < afloat[i]; j++) {
+                    if (vertical) {
+                        target[start_y + j][start_x]++;
+                    } else {
+                        target[start_y][start_x + j]++;
+                    }
+                }
+            }
+        }
+    }
+    BITBOARD_SET (&open_hits_board, x, y);
+}
+
+// Marks a ship of the player's starting at x, y as sunk. Its places are taken away, then its cells are blocked.
+// Each cell is blocked before its open hit is closed so the places through it come off the target counts too
+static void ai_sink (uint8_t x, uint8_t y, uint8_t length, bool vertical)
+{
+    uint8_t i;
+    uint8_t k;
+
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        if (afloat[i] == length) {
+            ai_density_add_ship (length, -1);
+            afloat[i] = 0;
+            break;
+        }
+    }
+
+    for (k = 0; k < length; k++) {
+        uint8_t cell_x = x + (vertical ? 0 : k);
+        uint8_t cell_y = y + (vertical ? k : 0);
+        if (cell_x >= LEDMAT_ROWS_NUM || cell_y >= LEDMAT_COLS_NUM) continue;
+        ai_block (cell_x, cell_y);
+        BITBOARD_RESET (&open_hits_board, cell_x, cell_y);
+    }
+}
+
+// Picks the cell to fire at. While a hit ship is still afloat only the places through the hits count,
+// otherwise the places over the whole board do. Ties are broken at random
+static void ai_choose_shot (uint8_t* shot_x, uint8_t* shot_y)
+{
+    uint8_t (*counts)[LEDMAT_ROWS_NUM] = density;
+    int16_t best = -1;
+    uint8_t ties = 0;
+    uint8_t x;
+    uint8_t y;
+
+    if (bitboard_count (&open_hits_board)) counts = target;
+
+    *shot_x = 0;
+    *shot_y = 0;
+    for (y = 0; y < LEDMAT_COLS_NUM; y++) {
+        for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
+            if (BITBOARD_TEST (&shot_board, x, y)) continue;
+
+            if (counts[y][x] > best) {
+                best = counts[y][x];
+                ties = 0;
+            }
+            // Each cell as good as the best is kept with a chance of one in the number seen so far
+            if (counts[y][x] == best && ai_random () % ++ties == 0) {
+                *shot_x = x;
+                *shot_y = y;
+            }
+        }
+    }
+}
+
+// Places the computer's ships at random where they don't overlap
+static void ai_place_fleet (void)
+{
+    bitboard_t fleet;
+    bitboard_t anchors;
+    uint8_t i;
+    uint8_t x;
+    uint8_t y;
+
+    bitboard_clear (&fleet);
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        PlayerShip* ship = &ai_ships[i];
+        ship->length = get_ship_length (i);
+        ship->vertical = ai_random () & 1;
+        ship->damage = 0;
+
+        bitboard_anchors (&anchors, &fleet, ship->length, ship->vertical);
+        if (!bitboard_count (&anchors)) {
+            ship->vertical = !ship->vertical;
+            bitboard_anchors (&anchors, &fleet, ship->length, ship->vertical);
+        }
+
+        // Take the pick'th place the ship fits
+        uint8_t count = bitboard_count (&anchors);
+        uint8_t pick = count ? ai_random () % count : 0;
+        ship->x = 0;
+        ship->y = 0;
+        for (y = 0; y < LEDMAT_COLS_NUM; y++) {
+            for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
+                if (!BITBOARD_TEST (&anchors, x, y)) continue;
+                if (pick-- == 0) {
+                    ship->x = x;
+                    ship->y = y;
+                }
+            }
+        }
+
+        bitboard_line (&fleet, ship->x, ship->y, ship->length, ship->vertical);
+        ship->placed = 1;
+    }
+}
+
+// Resolves the player's shot against the computer's fleet
+static void ai_resolve_shot (uint8_t x, uint8_t y, IrShotResult* result)
+{
+    uint8_t i;
+
+    result->x = x;
+    result->y = y;
+    result->hit = 0;
+    result->sunk = 0;
+
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        PlayerShip* ship = &ai_ships[i];
+        bool in_line = ship->vertical ? x == ship->x : y == ship->y;
+        uint8_t offset = ship->vertical ? y - ship->y : x - ship->x;
+        if (!in_line || offset >= ship->length) continue;
+
+        result->hit = 1;
+        if (!(ship->damage & (1 << offset))) {
+            ship->damage |= 1 << offset;
+            if (ship->damage == (1 << ship->length) - 1) {
+                ai_ships_lost++;
+                result->sunk = ship->length;
+                result->sunk_vertical = ship->vertical;
+                result->sunk_offset = offset;
+            }
+        }
+        break;
+    }
+
+    result->game_over = ai_ships_lost == SHIPS_COUNT;
+}
+
+// Holds a packet for the game until the inbound slot is free
+static void ai_send (ir_packet_t packet_type, const uint8_t* payload, uint8_t length)
+{
+    outbox_type = packet_type;
+    outbox_length = length;
+    if (length) memcpy (outbox_payload, payload, length);
+    outbox_full = 1;
+}
+
+// Takes the packets the game sends to the other kit
+static void ai_receive (ir_packet_t packet_type, const uint8_t* payload, uint8_t length)
+{
+    IrShotResult result;
+
+    if (packet_type == PACKET_SHIPS_PLACED) {
+        // The computer placed its ships when it started
+        ai_send (PACKET_SHIPS_PLACED, NULL, 0);
+
+    } else if (packet_type == PACKET_HITMISS_REQUEST && length >= 2) {
+        uint8_t answer[IR_RESULT_LENGTH];
+        ai_resolve_shot (payload[0], payload[1], &result);
+        ir_encode_result (&result, answer);
+        ai_send (PACKET_HITMISS_RESPONSE, answer, sizeof (answer));
+        ai_turn = !result.game_over;
+        ai_thinking = 0;
+
+    } else if (packet_type == PACKET_HITMISS_RESPONSE && ir_decode_result (payload, length, &result)) {
+        if (result.x >= LEDMAT_ROWS_NUM || result.y >= LEDMAT_COLS_NUM) return;
+
+        PROFILE_BEGIN (start);
+        if (!result.hit) {
+            ai_block (result.x, result.y);
+        } else {
+            ai_open_hit (result.x, result.y);
+            // The ship the shot sank starts sunk_offset cells back from the shot
+            if (result.sunk) {
+                if (result.sunk_vertical) {
+                    ai_sink (result.x, result.y - result.sunk_offset, result.sunk, 1);
+                } else {
+                    ai_sink (result.x - result.sunk_offset, result.y, result.sunk, 0);
+                }
+            }
+        }
+        PROFILE_END (PROFILE_AI, start);
+    }
+}
+
+// Places the computer's fleet and plays it as the other kit, used when no other kit answers over IR
+void ai_start (void)
+{
+    uint8_t i;
+
+    random_state = TCNT1 | 1;
+
+    bitboard_clear (&shot_board);
+    bitboard_clear (&blocked_board);
+    bitboard_clear (&open_hits_board);
+    memset (density, 0, sizeof (density));
+    memset (target, 0, sizeof (target));
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        afloat[i] = get_ship_length (i);
+        ai_density_add_ship (afloat[i], 1);
+    }
+
+    ai_place_fleet ();
+    ai_ships_lost = 0;
+
+    outbox_full = 0;
+    ai_turn = 0;
+    ai_thinking = 0;
+    think_ticks = 0;
+    ai_active = 1;
+    ir_set_local_peer (ai_receive);
+}
+
+// Stops playing the computer, packets go back out over IR
+void ai_stop (void)
+{
+    ai_active = 0;
+    ir_set_local_peer (NULL);
+}
+
+// Hands the computer's next packet to the game once the inbound slot is free, called every game tick
+void ai_tick (void)
+{
+    if (!ai_active) return;
+
+    if (think_ticks) think_ticks--;
+    if (outbox_full && ir_comms_deliver (outbox_type, outbox_payload, outbox_length)) outbox_full = 0;
+}
+
+// Lets the computer fire once it has thought for a moment, called while the player waits for their turn
+void ai_take_turn (void)
+{
+    if (!ai_active || !ai_turn || outbox_full) return;
+
+    if (!ai_thinking) {
+        ai_thinking = 1;
+        think_ticks = AI_THINK_TICKS;
+        return;
+    }
+    if (think_ticks) return;
+
+    uint8_t shot[2];
+    PROFILE_BEGIN (start);
+    ai_choose_shot (&shot[0], &shot[1]);
+    PROFILE_END (PROFILE_AI, start);
+    BITBOARD_SET (&shot_board, shot[0], shot[1]);
+    ai_turn = 0;
+    ai_thinking = 0;
+    ai_send (PACKET_HITMISS_REQUEST, shot, sizeof (shot));
+}
@@ -0,0 +1,23 @@
+/*
+# File:   ai.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   21 Oct 2017
+# Descr:  Header file for ai.c
+*/
+
+#ifndef AI_H
+#define AI_H
+
+// Places the computer's fleet and plays it as the other kit, used when no other kit answers over IR
+void ai_start (void);
+
+// Stops playing the computer, packets go back out over IR
+void ai_stop (void);
+
+// Hands the computer's next packet to the game once the inbound slot is free, called every game tick
+void ai_tick (void);
+
+// Lets the computer fire once it has thought for a moment, called while the player waits for their turn
+void ai_take_turn (void);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+# File:   anim.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Plays keyframe animations from flash using precomputed distance rings
+*/
+
+#include <avr/pgmspace.h>
+#include "system.h"
+#include "bitmap.h"
+#include "game.h"
+#include "anim.h"
+
+// Manhattan distance of a pixel from CENTRE_X, CENTRE_Y
+#define DIFF(A, B) ((A) > (B) ? (A) - (B) : (B) - (A))
+#define RING(X, Y) (DIFF (X, CENTRE_X) + DIFF (Y, CENTRE_Y))
+#define RING_ROW(X) {RING (X, 0), RING (X, 1), RING (X, 2), RING (X, 3), RING (X, 4)}
+
+static const uint8_t rings[LEDMAT_ROWS_NUM][LEDMAT_COLS_NUM] PROGMEM =
+{
+    RING_ROW (0), RING_ROW (1), RING_ROW (2), RING_ROW (3),
+    RING_ROW (4), RING_ROW (5), RING_ROW (6)
+};
+
+// Restarts an animation from its first step
+void anim_start (Animation* anim)
+{
+    anim->step = 0;
+    anim->tick = anim->step_ticks;
+}
+
+// Advances an animation by one tick, the step counts down so the keyframes travel outwards
+void anim_tick (Animation* anim)
+{
+    anim->tick--;
+    if (anim->tick == 0) {
+        anim->tick = anim->step_ticks;
+        anim->step = (anim->step == 0 ? anim->length - 1 : anim->step - 1);
+    }
+}
+
+// Draws the current step of the animation, the pixels in each ring around CENTRE_X, CENTRE_Y share a keyframe
+void anim_render_rings (const Animation* anim)
+{
+    uint8_t x;
+    uint8_t y;
+
+    for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
+        for (y = 0; y < LEDMAT_COLS_NUM; y++) {
+            uint8_t frame = pgm_read_byte (&rings[x][y]) + anim->step;
+            while (frame >= anim->length) frame -= anim->length;
+            bitmap_set_pixel (x, y, pgm_read_byte (&anim->keyframes[frame]));
+        }
+    }
+}
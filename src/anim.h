@@ -0,0 +1,32 @@
+/*
+# File:   anim.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Header file for anim.c
+*/
+
+#ifndef ANIM_H
+#define ANIM_H
+
+// Keyframe animation played from flash. Each step the keyframes move out by one
+// ring of pixels around the centre of the display
+struct anim_s{
+    const uint8_t* keyframes;   // Intensities, stored in flash
+    uint8_t length;             // Number of keyframes
+    uint8_t step_ticks;         // Ticks between steps
+    uint8_t step;
+    uint8_t tick;
+};
+
+typedef struct anim_s Animation;
+
+// Restarts an animation from its first step
+void anim_start (Animation* anim);
+
+// Advances an animation by one tick
+void anim_tick (Animation* anim);
+
+// Draws the current step of the animation, the pixels in each ring around CENTRE_X, CENTRE_Y share a keyframe
+void anim_render_rings (const Animation* anim);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+# File:   bitboard.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   20 Oct 2017
+# Descr:  Sets of board cells kept as one bit per cell, so whole boards can be compared at once
+*/
+
+#include <string.h>
+#include "system.h"
+#include "bitboard.h"
+
+// Clears every cell
+void bitboard_clear (bitboard_t* board)
+{
+    memset (board, 0, sizeof (*board));
+}
+
+// Returns the number of cells that are set
+uint8_t bitboard_count (const bitboard_t* board)
+{
+    uint8_t count = 0;
+    uint8_t y;
+
+    for (y = 0; y < LEDMAT_COLS_NUM; y++) {
+        uint8_t bits = board->cols[y];
+        // Each step clears the lowest set bit
+        while (bits) {
+            bits &= bits - 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+// Sets anchors to every cell a line length long can start at without leaving the board or crossing a cell set in occupied.
+// A horizontal line fits where the free cells of a column, shifted down by each cell of the line, all line up.
+// A vertical line fits where the free cells of each column it covers line up
+void bitboard_anchors (bitboard_t* anchors, const bitboard_t* occupied, uint8_t length, bool vertical)
+{
+    const uint8_t board_mask = (1 << LEDMAT_ROWS_NUM) - 1;
+    uint8_t y;
+    uint8_t k;
+
+    bitboard_clear (anchors);
+    if (length == 0) return;
+
+    if (vertical) {
+        if (length > LEDMAT_COLS_NUM) return;
+        for (y = 0; y + length <= LEDMAT_COLS_NUM; y++) {
+            uint8_t fits = board_mask;
+            for (k = 0; k < length; k++) {
+                fits &= ~occupied->cols[y + k];
+            }
+            anchors->cols[y] = fits;
+        }
+    } else {
+        if (length > LEDMAT_ROWS_NUM) return;
+        // Lines starting past this x would run off the board
+        uint8_t start_mask = (1 << (LEDMAT_ROWS_NUM - length + 1)) - 1;
+        for (y = 0; y < LEDMAT_COLS_NUM; y++) {
+            uint8_t free = ~occupied->cols[y] & board_mask;
+            uint8_t fits = free;
+            for (k = 1; k < length; k++) {
+                fits &= free >> k;
+            }
+            anchors->cols[y] = fits & start_mask;
+        }
+    }
+}
+
+// Sets the cells of a line length long starting at x, y, going up y if vertical and up x if not.
+// Cells off the board are left out
+void bitboard_line (bitboard_t* board, uint8_t x, uint8_t y, uint8_t length, bool vertical)
+{
+    if (x >= LEDMAT_ROWS_NUM || y >= LEDMAT_COLS_NUM) return;
+
+    if (vertical) {
+        uint8_t end = (y + length < LEDMAT_COLS_NUM ? y + length : LEDMAT_COLS_NUM);
+        for (; y < end; y++) {
+            BITBOARD_SET (board, x, y);
+        }
+    } else {
+        board->cols[y] |= (((1 << length) - 1) << x) & ((1 << LEDMAT_ROWS_NUM) - 1);
+    }
+}
@@ -0,0 +1,34 @@
+/*
+# File:   bitboard.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   20 Oct 2017
+# Descr:  Header file for bitboard.c
+*/
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+// One bit for each cell of the board, bit x of cols[y] is the cell at x, y
+typedef struct
+{
+    uint8_t cols[LEDMAT_COLS_NUM];
+} bitboard_t;
+
+// Reads, sets and clears the cell at X, Y
+#define BITBOARD_TEST(BOARD, X, Y) (((BOARD)->cols[Y] >> (X)) & 1)
+#define BITBOARD_SET(BOARD, X, Y) ((BOARD)->cols[Y] |= (1 << (X)))
+#define BITBOARD_RESET(BOARD, X, Y) ((BOARD)->cols[Y] &= ~(1 << (X)))
+
+// Clears every cell
+void bitboard_clear (bitboard_t* board);
+
+// Returns the number of cells that are set
+uint8_t bitboard_count (const bitboard_t* board);
+
+// Sets anchors to every cell a line length long can start at without leaving the board or crossing a cell set in occupied
+void bitboard_anchors (bitboard_t* anchors, const bitboard_t* occupied, uint8_t length, bool vertical);
+
+// Sets the cells of a line length long starting at x, y, going up y if vertical and up x if not
+void bitboard_line (bitboard_t* board, uint8_t x, uint8_t y, uint8_t length, bool vertical);
+
+#endif
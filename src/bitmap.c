@@ -5,123 +5,234 @@
 # Descr:  Allows manipulation of a bitmap to be displayed on led matrix at a variable intensity
 */
 
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "system.h"
 #include "../../utils/font.h"
 #include "ledmatrix.h"
+#include "pacer.h"
+#include "bitmap.h"
+#include "profile.h"
 #include <string.h>
 #include <ctype.h>
 
 #include "../../fonts/font3x5_1.h"
 
-#define FONT_SCROLL_TICKS 32
-static uint8_t bitmap[LEDMAT_ROWS_NUM][LEDMAT_COLS_NUM] = {{0, }};
-static int pwm_tick = 0;
-static int scroll_tick = FONT_SCROLL_TICKS;
+// Fewest timer counts between the refresh interrupt returning and its next compare match
+#define REFRESH_MIN_LEAD 16
+
+#if LUMINANCE_STEPS != 15
+#error "gamma table expects 16 luminance levels"
+#endif
+
+// Gamma 2 curve from an intensity to a binary code modulation value, every lit intensity gets at least 1
+#define BCM_MAX ((1 << LUMINANCE_DEPTH) - 1)
+#define GAMMA(I) ((I) ? (uint8_t) ((uint16_t) (I) * (I) * (BCM_MAX - 1) / (LUMINANCE_STEPS * LUMINANCE_STEPS) + 1) : 0)
 
-typedef enum
+static const uint8_t gamma_table[LUMINANCE_STEPS + 1] PROGMEM =
 {
-    /** Left, center and right aligned text  */
-    BITMAP_ALIGN_LEFT,
-    BITMAP_ALIGN_CENTER,
-    BITMAP_ALIGN_RIGHT
-} bitmap_font_align_t;
-
-// Function to be called once per loop to render the bitmap
-void bitmap_display (void)
+    GAMMA (0), GAMMA (1), GAMMA (2), GAMMA (3), GAMMA (4), GAMMA (5), GAMMA (6), GAMMA (7),
+    GAMMA (8), GAMMA (9), GAMMA (10), GAMMA (11), GAMMA (12), GAMMA (13), GAMMA (14), GAMMA (15)
+};
+
+// Frames kept as one row mask per display column and per bitplane. A row bit is set
+// in frame[column][plane] when that bit of the pixel's gamma corrected value is set, so
+// the scan only has to pick out a single byte per column and plane.
+// The refresh interrupt shows the front frame while the game draws into another one. There are three,
+// so the game never draws into a frame the interrupt may still be finishing a column of
+#define FRAMES_NUM 3
+static uint8_t frames[FRAMES_NUM][LEDMAT_COLS_NUM][LUMINANCE_DEPTH] = {{{0, }}};
+static volatile uint8_t front_frame = 0;
+static uint8_t draw_frame = 1;
+static int scroll_tick = FONT_SCROLL_TICKS;
+
+// Longest text that can be scrolled, in columns (FONT_WIDTH + 1 per character).
+// The profile screen's lines are longer than anything else shown, so only profile builds need the bigger strip
+#ifdef PROFILE
+#define FONT_STRIP_MAX_COLS 128
+#else
+#define FONT_STRIP_MAX_COLS 64
+#endif
+
+// Text currently being scrolled, rendered once into one byte per column
+static uint8_t font_strip[FONT_STRIP_MAX_COLS];
+static uint8_t font_strip_cols = 0;
+static char* font_strip_string = NULL;
+
+// Shows the next bitplane of the front frame for a time weighted by its bit, so each column
+// takes LUMINANCE_DEPTH interrupts rather than one per brightness level
+ISR (TIMER1_COMPB_vect)
 {
-    uint8_t x;
-    uint8_t row_pattern = 0x00;
     static uint8_t current_column = 0;
+    static uint8_t current_plane = 0;
+    static uint8_t scan_frame = 0;
+    PROFILE_BEGIN (start);
+
+    // A new front frame is only picked up at the start of a column, so no column mixes the planes of two frames
+    if (current_plane == 0) scan_frame = front_frame;
+    display_column(frames[scan_frame][current_column][current_plane], current_column);
+    OCR1B += LUMINANCE_UNIT << current_plane;
+
+    // If the interrupt was held up past the next match, don't wait for the timer to wrap around
+    if ((int16_t) (OCR1B - TCNT1) < REFRESH_MIN_LEAD) {
+        OCR1B = TCNT1 + REFRESH_MIN_LEAD;
+    }
 
-    for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
-        if (x > 0) row_pattern <<= 1;
-        row_pattern |= (bitmap[x][LEDMAT_COLS_NUM-1-current_column] > pwm_tick);
+    current_plane++;
+    if (current_plane >= LUMINANCE_DEPTH) {
+        current_plane = 0;
+        current_column = (current_column + 1) % LEDMAT_COLS_NUM;
     }
 
-    display_column(row_pattern, current_column);
+    PROFILE_END (PROFILE_DISPLAY, start);
+}
 
-    current_column = (current_column + 1) % LEDMAT_COLS_NUM;
+// Starts refreshing the led matrix from the Timer1 compare B interrupt, call after pacer_init
+void bitmap_init (void)
+{
+    OCR1B = TCNT1 + LUMINANCE_UNIT;
+    TIFR1 = (1 << OCF1B);
+    TIMSK1 |= (1 << OCIE1B);
+}
 
-    pwm_tick++;
-    if (pwm_tick >= UPDATE_RATE / PWM_RATE) {
-        pwm_tick = 0;
-    }
+// Shows the frame drawn since the last swap. The interrupt may still be finishing a column of the old
+// front frame, so drawing continues on the frame that is neither the old nor the new front
+void bitmap_swap (void)
+{
+    uint8_t old_front = front_frame;
+    front_frame = draw_frame;
+    // The three frame numbers add up to 3, so taking away the two fronts leaves the free one
+    draw_frame = 3 - old_front - draw_frame;
 }
 
 // Set an individual pixel in the bitmap
 void bitmap_set_pixel (uint8_t x, uint8_t y, uint8_t intensity)
 {
     if(x >= LEDMAT_ROWS_NUM || y >= LEDMAT_COLS_NUM) return;
-    bitmap[x][y] = intensity;
+    if(intensity > LUMINANCE_STEPS) intensity = LUMINANCE_STEPS;
+
+    uint8_t *planes = frames[draw_frame][LEDMAT_COLS_NUM - 1 - y];
+    uint8_t row_bit = 1 << (LEDMAT_ROWS_NUM - 1 - x);
+    uint8_t value = pgm_read_byte (&gamma_table[intensity]);
+    uint8_t plane;
+
+    for (plane = 0; plane < LUMINANCE_DEPTH; plane++) {
+        if ((value >> plane) & 1) {
+            planes[plane] |= row_bit;
+        } else {
+            planes[plane] &= ~row_bit;
+        }
+    }
 }
 
 // Returns a single coordinate on the bitmap
 uint8_t bitmap_get_pixel (uint8_t x, uint8_t y)
 {
-    return bitmap[x][y];
+    const uint8_t *planes = frames[draw_frame][LEDMAT_COLS_NUM - 1 - y];
+    uint8_t row_bit = 1 << (LEDMAT_ROWS_NUM - 1 - x);
+    uint8_t value = 0;
+    uint8_t intensity = 0;
+    uint8_t plane;
+
+    for (plane = 0; plane < LUMINANCE_DEPTH; plane++) {
+        if (planes[plane] & row_bit) value |= 1 << plane;
+    }
+
+    // Map the gamma corrected value back to the intensity it was set from
+    while (intensity < LUMINANCE_STEPS && pgm_read_byte (&gamma_table[intensity]) != value) {
+        intensity++;
+    }
+    return intensity;
 }
 
 // Clears the bitmap
 void bitmap_clear (void)
 {
-    int x;
-    int y;
-    for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
-        for (y = 0; y < LEDMAT_COLS_NUM; y++) {
-            bitmap_set_pixel(x, y, 0);
-        }
-    }
+    memset (frames[draw_frame], 0, sizeof (frames[0]));
 }
 
 // Determines the amount of ticks for the amount of time it takes to scroll through the text
 int bitmap_get_font_ticks(char* string)
 {
     int string_length = strlen(string);
-    return FONT_SCROLL_TICKS * (string_length * (FONT_WIDTH + 1) + LEDMAT_ROWS_NUM);
+    return BITMAP_STRIP_TICKS (string_length * (FONT_WIDTH + 1));
 }
 
 // Resets the scroll tick
 void bitmap_reset_font_scroll (void)
 {
     scroll_tick = 0;
+    font_strip_string = NULL;
 }
 
-//
-void bitmap_render_font (char* string, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, int scroll)
+// Renders a string into the font strip, one byte per column with bit y set for each lit pixel
+static void bitmap_render_font_strip (char* string)
 {
     uint8_t x;
     uint8_t y;
-    uint8_t string_length = strlen(string);
     uint8_t i = 0;
+    uint8_t strip_x = 0;
 
-    while(string[i] != '\0') {
+    while(string[i] != '\0' && strip_x + FONT_WIDTH + 1 <= FONT_STRIP_MAX_COLS) {
+        char ch = toupper(string[i]);
         for(x = 0; x < FONT_WIDTH; x++) {
-            for(y = 0; y < FONT_HEIGHT; y++){
-                int offset_x = x + i * (FONT_WIDTH + 1);
+            uint8_t column = 0;
+            for(y = 0; y < FONT_HEIGHT; y++) {
+                if(font_pixel_get(&font3x5_1, ch, x, FONT_HEIGHT-1-y)) column |= 1 << y;
+            }
+            font_strip[strip_x++] = column;
+        }
+        // Gap between characters
+        font_strip[strip_x++] = 0;
+        i++;
+    }
 
-                if(align == BITMAP_ALIGN_CENTER) {
-                    offset_x -= string_length * (FONT_WIDTH + 1) / 2;
-                } else if(align == BITMAP_ALIGN_RIGHT) {
-                    offset_x -= string_length * (FONT_WIDTH + 1);
-                }
+    font_strip_cols = strip_x;
+    font_strip_string = string;
+}
 
-                int draw_x = pos_x + offset_x + LEDMAT_ROWS_NUM - scroll_tick / 32;
-                int draw_y = pos_y + y;
+// Draws the columns of a rendered strip that are currently on screen and advances the scroll by the given number of ticks
+static void bitmap_draw_strip (const uint8_t* columns, bool in_flash, uint8_t cols, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, uint8_t scroll)
+{
+    uint8_t y;
+    int draw_x;
 
-                if(draw_x < 0 || draw_x >= LEDMAT_ROWS_NUM || draw_y >= LEDMAT_COLS_NUM || draw_y < 0) {
-                    continue;
-                }
+    int start_x = pos_x + LEDMAT_ROWS_NUM - scroll_tick / FONT_SCROLL_TICKS;
+    if(align == BITMAP_ALIGN_CENTER) {
+        start_x -= cols / 2;
+    } else if(align == BITMAP_ALIGN_RIGHT) {
+        start_x -= cols;
+    }
 
-                bool pixel_on = font_pixel_get(&font3x5_1, toupper(string[i]), x, FONT_HEIGHT-1-y);
-                if(pixel_on) bitmap_set_pixel(draw_x, draw_y, (pixel_on ? LUMINANCE_STEPS : 0));
-            }
+    for(draw_x = 0; draw_x < LEDMAT_ROWS_NUM; draw_x++) {
+        int strip_x = draw_x - start_x;
+        if(strip_x < 0 || strip_x >= cols) continue;
+
+        uint8_t column = (in_flash ? pgm_read_byte (&columns[strip_x]) : columns[strip_x]);
+        for(y = 0; y < FONT_HEIGHT; y++) {
+            if((column >> y) & 1) bitmap_set_pixel(draw_x, pos_y + y, LUMINANCE_STEPS);
         }
-        i++;
     }
 
-    if(scroll) scroll_tick++;
+    scroll_tick += scroll;
 
-    if(scroll_tick == bitmap_get_font_ticks(string)){
+    if(scroll_tick >= BITMAP_STRIP_TICKS (cols)){
         scroll_tick = 0;
     }
 }
+
+// Draws the string, only the columns currently on screen are copied from the font strip.
+// The string is rendered into the strip again whenever a different string is passed in,
+// or after bitmap_reset_font_scroll for a buffer whose contents have changed
+void bitmap_render_font (char* string, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, uint8_t scroll)
+{
+    if(string != font_strip_string) bitmap_render_font_strip (string);
+
+    bitmap_draw_strip (font_strip, 0, font_strip_cols, pos_x, pos_y, align, scroll);
+}
+
+// Draws scrolling text that was pre-rendered into flash, see messages.def
+void bitmap_render_strip (bitmap_strip_t strip, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, uint8_t scroll)
+{
+    bitmap_draw_strip (strip.columns, 1, strip.cols, pos_x, pos_y, align, scroll);
+}
@@ -8,6 +8,18 @@
 #ifndef BITMAP_H
 #define BITMAP_H
 
+// Game ticks each column of scrolling text moves after
+#define FONT_SCROLL_TICKS 8
+
+// Text pre-rendered into flash by messages_gen, one byte per column
+typedef struct {
+    const uint8_t* columns;
+    uint8_t cols;
+} bitmap_strip_t;
+
+// Ticks taken to scroll a strip of the given number of columns across the display
+#define BITMAP_STRIP_TICKS(COLS) (FONT_SCROLL_TICKS * ((COLS) + LEDMAT_ROWS_NUM))
+
 typedef enum
 {
     /** Left, center and right aligned text  */
@@ -16,8 +28,11 @@ typedef enum
     BITMAP_ALIGN_RIGHT
 } bitmap_font_align_t;
 
-// Function to be called once per loop to render the bitmap
-void bitmap_display (void);
+// Starts refreshing the led matrix from the Timer1 compare B interrupt, call after pacer_init
+void bitmap_init (void);
+
+// Shows the frame drawn since the last swap, drawing then continues on the other frame
+void bitmap_swap (void);
 
 // Clears the bitmap
 void bitmap_clear (void);
@@ -34,7 +49,10 @@ int bitmap_get_font_ticks(char* string);
 // Resets the scroll tick
 void bitmap_reset_font_scroll (void);
 
-//
-void bitmap_render_font (char* string, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, bool scrolling);
+// Draws scrolling text and moves it on by scroll ticks, the string is rendered once and kept until a different string is drawn
+void bitmap_render_font (char* string, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, uint8_t scroll);
+
+// Draws scrolling text that was pre-rendered into flash, see messages.def
+void bitmap_render_strip (bitmap_strip_t strip, uint8_t pos_x, uint8_t pos_y, bitmap_font_align_t align, uint8_t scroll);
 
 #endif
@@ -14,25 +14,23 @@
 #include "ircomms.h"
 #include "game.h"
 
-#define SHIP_HIT_FLASH_TICKS 150
+#define SHIP_HIT_FLASH_TICKS (GAME_TICK_RATE / 3)
 
 static uint8_t crosshair_x = CENTRE_X;
 static uint8_t crosshair_y = CENTRE_Y;
 static uint8_t last_guessed_x;
 static uint8_t last_guessed_y;
 
+// A request has been sent for the last guess and its response hasn't arrived, no other shot is sent until it does
+static bool shot_outstanding = 0;
+
 void reset_crosshair_position (void)
 {
     crosshair_x = CENTRE_X;
     crosshair_y = CENTRE_Y;
     last_guessed_x = 0;
     last_guessed_y = 0;
-}
-
-// Changes the game state to choose target state
-void state_choose_target_init (void)
-{
-    set_game_state (STATE_CHOOSE_TARGET);
+    shot_outstanding = 0;
 }
 
 // Displays the crosshair, allows it to be moved around using the navswitch. Sends a hit or miss request with the coordinates when the navswitch is pushed
@@ -59,10 +57,12 @@ void state_choose_target_tick (void)
             crosshair_y++;
         }
     }
-    // Sends a hit or miss request with the coordinates if the selected led pin has not been shot at before
+    // Sends a hit or miss request with the coordinates if the selected led pin has not been shot at before,
+    // only one shot is sent each turn
     if (navswitch_push_event_p (NAVSWITCH_PUSH)) {
 
-        if (!coords_have_been_guessed (crosshair_x, crosshair_y)) {
+        if (!shot_outstanding && !coords_have_been_guessed (crosshair_x, crosshair_y)) {
+            shot_outstanding = 1;
             last_guessed_x = crosshair_x;
             last_guessed_y = crosshair_y;
             led_on ();
@@ -71,17 +71,27 @@ void state_choose_target_tick (void)
 
     }
 
-    if (ir_get_incoming_type () == PACKET_HITMISS_RESPONSE) {
+    IrShotResult result;
+    if (ir_get_incoming_result (&result)) {
 
-        // Ignore HITMISS_RESPONSE that have already been processed
-        if (!coords_have_been_guessed (crosshair_x, crosshair_y)) {
+        // Ignore HITMISS_RESPONSE that have already been processed or aren't for the last shot
+        if (shot_outstanding && result.x == last_guessed_x && result.y == last_guessed_y && !coords_have_been_guessed (result.x, result.y)) {
+            shot_outstanding = 0;
 
-            if (ir_get_incoming_bool ()) {
-                set_coords_hitmiss (last_guessed_x, last_guessed_y, 1);
-                state_shot_hit_init ();
+            if (result.hit) {
+                set_coords_hitmiss (result.x, result.y, 1);
+                // The ship the shot sank starts sunk_offset cells back from the shot
+                if (result.sunk) {
+                    if (result.sunk_vertical) {
+                        set_enemy_ship_sunk (result.x, result.y - result.sunk_offset, result.sunk, 1);
+                    } else {
+                        set_enemy_ship_sunk (result.x - result.sunk_offset, result.y, result.sunk, 0);
+                    }
+                }
+                set_game_state (STATE_SHOT_HIT);
             } else {
-                set_coords_hitmiss (last_guessed_x, last_guessed_y, 0);
-                state_shot_miss_init ();
+                set_coords_hitmiss (result.x, result.y, 0);
+                set_game_state (STATE_SHOT_MISS);
             }
 
         }
@@ -100,8 +110,10 @@ void state_choose_target_tick (void)
     }
     for (i = 0; i < LEDMAT_ROWS_NUM; i++) {
         for (j = 0; j < LEDMAT_COLS_NUM; j++) {
-            if(coords_have_been_hit (i, j) && flash) bitmap_set_pixel(i, j, 1);
-            if(coords_have_been_missed (i, j)) bitmap_set_pixel(i, j, 1);
+            // Sunk ships stay lit, hits on ships still afloat flash
+            if(coords_are_sunk (i, j)) bitmap_set_pixel(i, j, LUMINANCE_STEPS / 4);
+            else if(coords_have_been_hit (i, j) && flash) bitmap_set_pixel(i, j, LUMINANCE_STEPS / 4);
+            if(coords_have_been_missed (i, j)) bitmap_set_pixel(i, j, LUMINANCE_STEPS / 4);
         }
     }
     // Displays the crosshair, 4
@@ -11,9 +11,6 @@
 // Resets the position of the choose target crosshair
 void reset_crosshair_position (void);
 
-// Changes the game state to choose target state
-void state_choose_target_init (void);
-
 // Displays the crosshair, allows it to be moved around using the navswitch. Sends a hit or miss request with the coordinates when the navswitch is pushed
 void state_choose_target_tick (void);
 
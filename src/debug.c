@@ -0,0 +1,136 @@
+/*
+# File:   debug.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   19 Oct 2017
+# Descr:  Debug screen for the IR link counters, opened with a hidden navswitch sequence
+*/
+
+#include "system.h"
+#include "bitmap.h"
+#include "navswitch.h"
+#include "ircomms.h"
+#include "game.h"
+#include "debug.h"
+
+// Pages of counters, each starts with a two letter name and shows at most two counts so
+// the line fits the text strip of a release build:
+// TX and RX bytes frames, RT srtt rto, RS retries session drops, FE corrected uncorrectable,
+// CE crc length errors, DR bytes dropped, L1 to L3 the acknowledgement latency buckets
+enum
+{
+    PAGE_TX,
+    PAGE_RX,
+    PAGE_TIMING,
+    PAGE_RESENDS,
+    PAGE_FEC,
+    PAGE_CHECK,
+    PAGE_DROPPED,
+    PAGE_LATENCY_1,
+    PAGE_LATENCY_2,
+    PAGE_LATENCY_3,
+    PAGES_NUM
+};
+
+static const char page_names[PAGES_NUM][2] = {"TX", "RX", "RT", "RS", "FE", "CE", "DR", "L1", "L2", "L3"};
+
+// Page shown on the debug screen and the text for it, a name and two five digit counts
+static uint8_t debug_page = 0;
+static char debug_text[16];
+static int debug_ticks = 0;
+
+// Writes a number in decimal followed by a space, returns the position after it
+uint8_t debug_format_number (char* text, uint8_t pos, uint32_t value)
+{
+    char digits[10];
+    uint8_t length = 0;
+
+    do {
+        digits[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (length) text[pos++] = digits[--length];
+    text[pos++] = ' ';
+    return pos;
+}
+
+// Formats the debug screen text for the current page
+static void debug_ir_format (void)
+{
+    IrStats stats;
+    uint16_t values[2];
+    uint8_t count = 0;
+    uint8_t pos = 0;
+    uint8_t i;
+
+    ir_get_stats (&stats);
+
+    if (debug_page == PAGE_TX) {
+        values[count++] = stats.bytes_sent;
+        values[count++] = stats.frames_sent;
+    } else if (debug_page == PAGE_RX) {
+        values[count++] = stats.bytes_received;
+        values[count++] = stats.frames_received;
+    } else if (debug_page == PAGE_TIMING) {
+        values[count++] = ir_get_srtt ();
+        values[count++] = ir_get_rto ();
+    } else if (debug_page == PAGE_RESENDS) {
+        values[count++] = stats.retries;
+        values[count++] = stats.session_drops;
+    } else if (debug_page == PAGE_FEC) {
+        values[count++] = stats.corrected;
+        values[count++] = stats.uncorrectable;
+    } else if (debug_page == PAGE_CHECK) {
+        values[count++] = stats.crc_errors;
+        values[count++] = stats.length_errors;
+    } else if (debug_page == PAGE_DROPPED) {
+        values[count++] = stats.dropped;
+    } else {
+        uint8_t first = 2 * (debug_page - PAGE_LATENCY_1);
+        values[count++] = stats.latency[first];
+        values[count++] = stats.latency[first + 1];
+    }
+
+    debug_text[pos++] = page_names[debug_page][0];
+    debug_text[pos++] = page_names[debug_page][1];
+    debug_text[pos++] = ' ';
+    for (i = 0; i < count; i++) {
+        pos = debug_format_number (debug_text, pos, values[i]);
+    }
+    debug_text[pos - 1] = '\0';
+
+    bitmap_reset_font_scroll ();
+    debug_ticks = bitmap_get_font_ticks (debug_text);
+}
+
+// Formats the first page of IR link counters when the IR debug state is entered
+void state_debug_ir_enter (void)
+{
+    debug_ir_format ();
+}
+
+// Scrolls one page of IR link counters. Left and right pick the page, up clears the counters, push restarts the game
+void state_debug_ir_tick (void)
+{
+    if (navswitch_push_event_p (NAVSWITCH_PUSH)) {
+        return game_init ();
+    }
+
+    if (navswitch_push_event_p (NAVSWITCH_EAST)) {
+        debug_page = (debug_page + 1) % PAGES_NUM;
+        debug_ir_format ();
+    } else if (navswitch_push_event_p (NAVSWITCH_WEST)) {
+        debug_page = (debug_page == 0 ? PAGES_NUM - 1 : debug_page - 1);
+        debug_ir_format ();
+    } else if (navswitch_push_event_p (NAVSWITCH_NORTH)) {
+        // Start counting again, to see what one test adds
+        ir_clear_stats ();
+        debug_ir_format ();
+    }
+
+    bitmap_render_font (debug_text, 0, 0, BITMAP_ALIGN_LEFT, 1);
+
+    // Pick up the latest counts each time the text has scrolled past
+    debug_ticks--;
+    if (debug_ticks == 0) debug_ir_format ();
+}
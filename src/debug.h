@@ -0,0 +1,20 @@
+/*
+# File:   debug.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   19 Oct 2017
+# Descr:  Header file for debug.c
+*/
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+// Writes a number in decimal followed by a space, returns the position after it
+uint8_t debug_format_number (char* text, uint8_t pos, uint32_t value);
+
+// Formats the first page of IR link counters when the IR debug state is entered
+void state_debug_ir_enter (void);
+
+// Scrolls one page of IR link counters. Left and right pick the page, up clears the counters, push restarts the game
+void state_debug_ir_tick (void);
+
+#endif
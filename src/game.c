@@ -5,11 +5,11 @@
 # Descr:  Contains the main game logic for Battleship
 */
 
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "system.h"
 #include "bitmap.h"
 #include "pacer.h"
-#include <math.h>
-#include <stdlib.h>
 #include "led.h"
 #include "ledmatrix.h"
 #include "navswitch.h"
@@ -17,72 +17,163 @@
 #include "ir_uart.h"
 #include "ircomms.h"
 #include "choose_target.h"
+#include "messages.h"
+#include "anim.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "debug.h"
+#include "bitboard.h"
+#include "ai.h"
 
-static PlayerShip player_ships[SHIPS_COUNT] = {{0, 0, 4, 1, 0}, {0, 0, 3, 1, 0}, {0, 0, 3, 1, 0}};
+static PlayerShip player_ships[SHIPS_COUNT] = {{0, 0, 4, 1, 0, 0}, {0, 0, 3, 1, 0, 0}, {0, 0, 3, 1, 0, 0}};
 
-static bool hits_map[LEDMAT_ROWS_NUM][LEDMAT_COLS_NUM] = {{0, }};
-static bool misses_map[LEDMAT_ROWS_NUM][LEDMAT_COLS_NUM] = {{0, }};
+// The player's shots at the enemy, the cells of the player's placed ships and the enemy's shots at them
+static bitboard_t hits_board;
+static bitboard_t misses_board;
+static bitboard_t fleet_board;
+static bitboard_t enemy_shots_board;
+
+// Ships sunk on each side and the cells of the enemy ships the player has sunk
+static uint8_t ships_lost = 0;
+static uint8_t enemy_ships_sunk = 0;
+static bitboard_t sunk_board;
+
+// The last shot to hit sank its ship
+static bool last_shot_sunk = 0;
+
+// Where the ship being moved could be placed, by the cell it starts at
+static bitboard_t legal_anchors;
 
 static game_state_t game_state;
 static bool enemy_has_placed_ships = 0;
 static bool is_player_turn = 0;
 
-static uint8_t my_hit_count = 0;
-static uint8_t enemy_hit_count = 0;
-
 static int anim_ticks = 0;
+static bool instruction_shown = 0;
+
+// Game ticks left before the current state runs again
+static uint8_t state_wait_ticks = 0;
+
+// Text only screens change only when the text scrolls along by a column
+#define TEXT_STATE_PERIOD FONT_SCROLL_TICKS
+
+struct state_s{
+    void (*enter) (void);
+    void (*tick) (void);
+    void (*exit) (void);
+    uint8_t period;     // Game ticks between runs, the frame is left on screen in between
+};
+
+typedef struct state_s StateHandlers;
+
+#define ACCEPTS(PACKET) (1 << (PACKET))
+
+// Packet types some state reads. One that arrives early, such as a shot while this kit is still showing
+// the result of its own, stays in the inbound slot until a state that reads it is entered
+#define GAME_ACCEPTS (ACCEPTS (PACKET_SHIPS_PLACED) | ACCEPTS (PACKET_HITMISS_REQUEST) | ACCEPTS (PACKET_HITMISS_RESPONSE))
+
+// Hooks for each game state, indexed by game_state_t. States that read the navswitch run
+// every tick so they never miss a push event
+static const StateHandlers states[GAME_STATES_NUM] PROGMEM =
+{
+    [STATE_INTRO_EXPLOSION]   = {state_intro_explosion_enter, state_intro_explosion_tick, NULL, 1},
+    [STATE_INTRO_TEXT]        = {state_intro_text_enter, state_intro_text_tick, state_intro_text_exit, 1},
+    [STATE_PLACE_SHIP_ROTATE] = {NULL, state_place_ship_rotate_tick, NULL, 1},
+    [STATE_PLACE_SHIP_MOVE]   = {state_place_ship_move_enter, state_place_ship_move_tick, NULL, 1},
+    [STATE_CHOOSE_TARGET]     = {NULL, state_choose_target_tick, NULL, 1},
+    [STATE_SHOT_HIT]          = {state_shot_hit_enter, state_shot_hit_tick, NULL, TEXT_STATE_PERIOD},
+    [STATE_SHOT_MISS]         = {state_shot_miss_enter, state_shot_miss_tick, NULL, TEXT_STATE_PERIOD},
+    [STATE_WAITING_TURN]      = {NULL, state_waiting_turn_tick, NULL, TEXT_STATE_PERIOD},
+    [STATE_WON]               = {NULL, state_won_tick, NULL, 1},
+    [STATE_LOST]              = {NULL, state_lost_tick, NULL, 1},
+    [STATE_DEBUG_IR]          = {state_debug_ir_enter, state_debug_ir_tick, NULL, 1},
+#ifdef PROFILE
+    [STATE_DEBUG_PROFILE]     = {state_debug_profile_enter, state_debug_profile_tick, NULL, 1},
+#endif
+};
+
+// Rings of light moving out from the centre of the display
+static const uint8_t explosion_keyframes[] PROGMEM = {0, 0, 0, 0, LUMINANCE_STEPS / 2, LUMINANCE_STEPS, LUMINANCE_STEPS};
+static Animation explosion = {explosion_keyframes, sizeof (explosion_keyframes), EXPLOSION_STEP_TICKS, 0, 0};
+
+// Hidden navswitch sequence on the intro screens that opens the IR link screen
+static const uint8_t ir_combo[] = {NAVSWITCH_EAST, NAVSWITCH_EAST, NAVSWITCH_WEST, NAVSWITCH_WEST};
+static uint8_t ir_combo_progress = 0;
+
+#ifdef PROFILE
+// Hidden navswitch sequence on the intro screens that opens the profiler screen
+static const uint8_t profile_combo[] = {NAVSWITCH_NORTH, NAVSWITCH_NORTH, NAVSWITCH_SOUTH, NAVSWITCH_SOUTH};
+static uint8_t profile_combo_progress = 0;
+#endif
 
 // Initialises the variables and resets ship placements, hits and misses count
 void game_init (void)
 {
-    state_intro_explosion_init ();
+    set_game_state (STATE_INTRO_EXPLOSION);
 
     // Reset ship placements
     uint8_t i;
     for (i = 0; i < SHIPS_COUNT; i++) {
         player_ships[i].placed = 0;
         player_ships[i].vertical = 1;
+        player_ships[i].damage = 0;
     }
+    ships_lost = 0;
+    enemy_ships_sunk = 0;
+    last_shot_sunk = 0;
 
     // Reset hits and misses
-    uint8_t j;
-    for (i = 0; i < LEDMAT_ROWS_NUM; i++) {
-        for (j = 0; j< LEDMAT_COLS_NUM; j++) {
-            hits_map[i][j] = 0;
-            misses_map[i][j] = 0;
-        }
-    }
+    bitboard_clear (&hits_board);
+    bitboard_clear (&misses_board);
+    bitboard_clear (&fleet_board);
+    bitboard_clear (&enemy_shots_board);
+    bitboard_clear (&sunk_board);
 
     enemy_has_placed_ships = 0;
     is_player_turn = 0;
-    my_hit_count = 0;
-    enemy_hit_count = 0;
     reset_crosshair_position ();
+    ai_stop ();
+    ir_set_shot_handler (NULL);
 }
 
-// Allows other modules to change the game state
+// Calls a state hook kept in the flash state table, hooks that aren't needed are left NULL
+static void state_hook_call (void (* const * hook) (void))
+{
+    void (*func) (void) = (void (*) (void)) (uintptr_t) pgm_read_word (hook);
+    if (func) func ();
+}
+
+// Allows other modules to change the game state. Runs the exit hook of the old state,
+// resets the text scroll and animation ticks every state starts from, then runs the enter hook of the new one
 void set_game_state (game_state_t state)
 {
+    state_hook_call (&states[game_state].exit);
+
     game_state = state;
+    state_wait_ticks = 0;
+    anim_ticks = 0;
+    bitmap_reset_font_scroll ();
+
+    state_hook_call (&states[game_state].enter);
 }
 
 // Checks if a particular coordinate has been guessed
 bool coords_have_been_guessed (uint8_t x, uint8_t y)
 {
-    return !hits_map[x][y] && !misses_map[x][y];
+    return ((hits_board.cols[y] | misses_board.cols[y]) >> x) & 1;
 }
 
 // Checks if a ship was hit by the player at x, y
 bool coords_have_been_hit (uint8_t x, uint8_t y)
 {
-    return hits_map[x][y];
+    return BITBOARD_TEST (&hits_board, x, y);
 }
 
 
 // Checks if a shot the player missed at x, y
 bool coords_have_been_missed (uint8_t x, uint8_t y)
 {
-    return misses_map[x][y];
+    return BITBOARD_TEST (&misses_board, x, y);
 }
 
 
@@ -90,16 +181,103 @@ bool coords_have_been_missed (uint8_t x, uint8_t y)
 void set_coords_hitmiss (uint8_t x, uint8_t y, bool hit)
 {
     if (hit) {
-        hits_map[x][y] = 1;
+        BITBOARD_SET (&hits_board, x, y);
     } else {
-        misses_map[x][y] = 1;
+        BITBOARD_SET (&misses_board, x, y);
     }
+    last_shot_sunk = 0;
+}
+
+// Returns the length of one of the ships each player places
+uint8_t get_ship_length (uint8_t index)
+{
+    return player_ships[index].length;
 }
 
-// Changes game state to ship rotate state
-void state_place_ship_rotate_init (void)
+// Checks if x, y is part of an enemy ship the player has sunk
+bool coords_are_sunk (uint8_t x, uint8_t y)
 {
-    game_state = STATE_PLACE_SHIP_ROTATE;
+    return BITBOARD_TEST (&sunk_board, x, y);
+}
+
+// Marks an enemy ship length long starting at x, y as sunk, the last shot is shown as sinking it
+void set_enemy_ship_sunk (uint8_t x, uint8_t y, uint8_t length, bool vertical)
+{
+    bitboard_line (&sunk_board, x, y, length, vertical);
+    enemy_ships_sunk++;
+    last_shot_sunk = 1;
+}
+
+// Matches navswitch pushes against a hidden sequence, true once the whole sequence has been pushed
+static bool navswitch_combo_check (const uint8_t* combo, uint8_t length, uint8_t* progress)
+{
+    static const uint8_t directions[] = {NAVSWITCH_NORTH, NAVSWITCH_EAST, NAVSWITCH_SOUTH, NAVSWITCH_WEST};
+    uint8_t i;
+
+    for (i = 0; i < sizeof (directions); i++) {
+        if (!navswitch_push_event_p (directions[i])) continue;
+
+        if (directions[i] == combo[*progress]) {
+            (*progress)++;
+        } else {
+            *progress = (directions[i] == combo[0]);
+        }
+
+        if (*progress == length) {
+            *progress = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Checks the hidden navswitch sequences that open the debug screens, true if one was opened
+static bool debug_combo_check (void)
+{
+    if (navswitch_combo_check (ir_combo, sizeof (ir_combo), &ir_combo_progress)) {
+        set_game_state (STATE_DEBUG_IR);
+        return 1;
+    }
+#ifdef PROFILE
+    if (navswitch_combo_check (profile_combo, sizeof (profile_combo), &profile_combo_progress)) {
+        set_game_state (STATE_DEBUG_PROFILE);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+// Resolves a shot from the other player against the player's ships, ircomms calls it as soon as a request
+// arrives once the fleet is final
+static void resolve_shot (uint8_t x, uint8_t y, IrShotResult* result)
+{
+    uint8_t i;
+
+    result->x = x;
+    result->y = y;
+    result->hit = BITBOARD_TEST (&fleet_board, x, y);
+    result->sunk = 0;
+
+    // Only the first hit on a cell damages the ship, the ship sinks once every cell of it has been hit.
+    // The ship hit is the one whose line x, y lies on
+    for (i = 0; i < SHIPS_COUNT && result->hit && !BITBOARD_TEST (&enemy_shots_board, x, y); i++) {
+        PlayerShip* ship = &player_ships[i];
+        bool in_line = ship->vertical ? x == ship->x : y == ship->y;
+        uint8_t offset = ship->vertical ? y - ship->y : x - ship->x;
+        if (!ship->placed || !in_line || offset >= ship->length) continue;
+
+        ship->damage |= 1 << offset;
+        if (ship->damage == (1 << ship->length) - 1) {
+            ships_lost++;
+            result->sunk = ship->length;
+            result->sunk_vertical = ship->vertical;
+            result->sunk_offset = offset;
+        }
+        break;
+    }
+    BITBOARD_SET (&enemy_shots_board, x, y);
+
+    result->game_over = ships_lost == SHIPS_COUNT;
 }
 
 // Allows ships to be rotated vertically or horizontally,
@@ -135,34 +313,74 @@ void state_place_ship_rotate_tick (void)
             if (navswitch_push_event_p (NAVSWITCH_PUSH)) {
                 player_ships[i].x = current_ship.x;
                 player_ships[i].y = current_ship.y;
-                state_place_ship_move_init ();
+                set_game_state (STATE_PLACE_SHIP_MOVE);
                 break;
             }
 
-            player_ship_render (current_ship, 1);
+            player_ship_render (current_ship, 1, LUMINANCE_STEPS);
         }
-        if (current_ship.placed) player_ship_render (current_ship, 0);
+        if (current_ship.placed) player_ship_render (current_ship, 0, LUMINANCE_STEPS);
     }
     // Determine which player goes first, the player who places all the ships first gets to start
     if (!found_unplaced) {
         if(enemy_has_placed_ships) {
-            state_waiting_turn_init ();
+            set_game_state (STATE_WAITING_TURN);
         } else {
             is_player_turn = 1;
-            state_choose_target_init ();
+            set_game_state (STATE_CHOOSE_TARGET);
         }
 
+        // If no other kit has been heard since power up, the computer plays instead. A kit that was heard
+        // and has gone quiet is only out of sight, so the game keeps waiting for it
+        if (!ir_comms_peer_heard ()) ai_start ();
+
+        // The fleet is final, shots from the other kit can be answered from now on
+        ir_set_shot_handler (resolve_shot);
         ir_send_ships_placed ();
     }
 }
 
-// Changes game state to placing ship state
-void state_place_ship_move_init (void)
+// Works out every position the ship about to be moved could be placed at, given the ships already placed
+void state_place_ship_move_enter (void)
 {
-    game_state = STATE_PLACE_SHIP_MOVE;
+    uint8_t i;
+    for (i = 0; i < SHIPS_COUNT; i++) {
+        if (!player_ships[i].placed) {
+            bitboard_anchors (&legal_anchors, &fleet_board, player_ships[i].length, player_ships[i].vertical);
+            return;
+        }
+    }
 }
 
-// Allows ships to be moved around the led matrix. Will not let you place a ship it will intersect with another ship
+// Moves a ship one step in a direction, skipping over positions where it can't be placed.
+// If it can't be placed anywhere that way it moves one cell, as long as it stays on the board
+static void place_ship_step (PlayerShip* ship, int8_t dx, int8_t dy)
+{
+    int8_t x = ship->x + dx;
+    int8_t y = ship->y + dy;
+
+    while (x >= 0 && x < LEDMAT_ROWS_NUM && y >= 0 && y < LEDMAT_COLS_NUM) {
+        if (BITBOARD_TEST (&legal_anchors, x, y)) {
+            ship->x = x;
+            ship->y = y;
+            return;
+        }
+        x += dx;
+        y += dy;
+    }
+
+    x = ship->x + dx;
+    y = ship->y + dy;
+    if (x >= 0 && y >= 0
+        && x + (!ship->vertical ? ship->length - 1 : 0) < LEDMAT_ROWS_NUM
+        && y + (ship->vertical ? ship->length - 1 : 0) < LEDMAT_COLS_NUM) {
+        ship->x = x;
+        ship->y = y;
+    }
+}
+
+// Allows ships to be moved around the led matrix. Will not let you place a ship it will intersect with another ship,
+// positions where it can't go are skipped and shown dimmed
 void state_place_ship_move_tick (void)
 {
     uint8_t i;
@@ -173,52 +391,34 @@ void state_place_ship_move_tick (void)
         if (!current_ship.placed && !found_unplaced) {
             found_unplaced = 1;
             // Allows ships to be moved using the navswitch
-            if (navswitch_push_event_p (NAVSWITCH_NORTH)
-                && current_ship.x + (!current_ship.vertical ? current_ship.length - 1 : 0) < LEDMAT_ROWS_NUM - 1) {
-                player_ships[i].x += 1;
-            }
-
-            if (navswitch_push_event_p (NAVSWITCH_EAST) && current_ship.y > 0) {
-                player_ships[i].y -= 1;
-            }
+            if (navswitch_push_event_p (NAVSWITCH_NORTH)) place_ship_step (&player_ships[i], 1, 0);
+            if (navswitch_push_event_p (NAVSWITCH_EAST)) place_ship_step (&player_ships[i], 0, -1);
+            if (navswitch_push_event_p (NAVSWITCH_SOUTH)) place_ship_step (&player_ships[i], -1, 0);
+            if (navswitch_push_event_p (NAVSWITCH_WEST)) place_ship_step (&player_ships[i], 0, 1);
 
-            if (navswitch_push_event_p (NAVSWITCH_SOUTH) && current_ship.x > 0) {
-                player_ships[i].x -= 1;
-            }
+            bool legal = BITBOARD_TEST (&legal_anchors, current_ship.x, current_ship.y);
 
-            if (navswitch_push_event_p (NAVSWITCH_WEST)
-                && current_ship.y + (current_ship.vertical ? current_ship.length - 1 : 0) < LEDMAT_COLS_NUM - 1) {
-                player_ships[i].y += 1;
-            }
             // Confirms the placement of the ship if navswitch is pushed, will not allow ships to overlap
-            if (navswitch_push_event_p(NAVSWITCH_PUSH)) {
-                uint8_t j = 0;
-                bool can_place = 1;
-                for(j = 0; j < SHIPS_COUNT && can_place; j++) {
-                    if(player_ships[j].placed && ship_intersects_with_ship(player_ships[j], current_ship)) {
-                        can_place = 0;
-                    }
-                }
-                if(can_place) {
-                    player_ships[i].placed = 1;
-                    state_place_ship_rotate_init ();
-                    break;
-                }
+            if (navswitch_push_event_p(NAVSWITCH_PUSH) && legal) {
+                bitboard_line (&fleet_board, current_ship.x, current_ship.y, current_ship.length, current_ship.vertical);
+                player_ships[i].placed = 1;
+                set_game_state (STATE_PLACE_SHIP_ROTATE);
+                break;
             }
-            player_ship_render (current_ship, 1);
+            player_ship_render (current_ship, 1, legal ? LUMINANCE_STEPS : LUMINANCE_STEPS / 4);
         }
-        if(current_ship.placed) player_ship_render (current_ship, 0);
+        if(current_ship.placed) player_ship_render (current_ship, 0, LUMINANCE_STEPS);
     }
 }
 
-// Renders an individual player ship to the bitmap
-void player_ship_render (PlayerShip ship, bool do_flash)
+// Renders an individual player ship to the bitmap at the given intensity
+void player_ship_render (PlayerShip ship, bool do_flash, uint8_t intensity)
 {
     static uint8_t flash_tick = SHIP_PLACEMENT_FLASH_TICKS;
     if (do_flash) flash_tick--;
     if (flash_tick == 0) flash_tick = SHIP_PLACEMENT_FLASH_TICKS;
 
-    uint8_t pixel = (flash_tick < SHIP_PLACEMENT_FLASH_TICKS / 2 && do_flash  ? 0 : LUMINANCE_STEPS);
+    uint8_t pixel = (flash_tick < SHIP_PLACEMENT_FLASH_TICKS / 2 && do_flash  ? 0 : intensity);
 
     if(ship.vertical) {
         int y;
@@ -234,197 +434,132 @@ void player_ship_render (PlayerShip ship, bool do_flash)
 }
 
 
-// Sets the amount of ticks for the animation and sets the game state to intro explosion state
-void state_intro_explosion_init (void)
+// Sets the amount of ticks for the animation
+void state_intro_explosion_enter (void)
 {
     anim_ticks = EXPLOSION_ANIMATION_TICKS;
-    game_state = STATE_INTRO_EXPLOSION;
+    anim_start (&explosion);
 }
 
 // Displays the explosion 3 times then displays the intro text, if button is pushed down, game state will change to rotating ship state
 void state_intro_explosion_tick (void)
 {
-    uint8_t x;
-    uint8_t y;
-    const uint8_t levels[] = {0, 0, 0, 0, 2, 4, 4};
+    anim_render_rings (&explosion);
+    anim_tick (&explosion);
+
+    if (debug_combo_check ()) return;
 
-    for (x = 0; x < LEDMAT_ROWS_NUM; x++) {
-        for (y = 0; y < LEDMAT_COLS_NUM; y++) {
-            uint8_t dx = abs (x - CENTRE_X);
-            uint8_t dy = abs (y - CENTRE_Y);
-            uint8_t r = dx + dy;
-            bitmap_set_pixel (x, y, levels[(int)(r + (float) anim_ticks / 60) % 7]);
-        }
-    }
     // If navswitch is pushed, it will stop the explosion and change to ship rotate state
     if (navswitch_push_event_p (NAVSWITCH_PUSH)) {
-        return state_place_ship_rotate_init ();
+        return set_game_state (STATE_PLACE_SHIP_ROTATE);
     }
     // If nothing has been pushed during the 3 explosions, it will change to display intro text
     anim_ticks--;
-    if(anim_ticks == 0) state_intro_text_init ();
+    if(anim_ticks == 0) set_game_state (STATE_INTRO_TEXT);
 }
 
-// Determines the amount of ticks for the intro text, changes game state to intro text state and resets the scroll
-void state_intro_text_init (void)
+// Determines the amount of ticks for the intro text
+void state_intro_text_enter (void)
 {
-    anim_ticks = bitmap_get_font_ticks ("BattleShip!");
-    game_state = STATE_INTRO_TEXT;
-    bitmap_reset_font_scroll ();
+    anim_ticks = MSG_BATTLESHIP_TICKS;
 }
 
 // Displays a scrolling intro text (Name of the game and instruction to start the game), if navswitch is pushed it will change to ship rotation selection state
 void state_intro_text_tick (void)
 {
-    static bool instruction_shown = 0;
+    bitmap_render_strip ((instruction_shown ? MSG_PUSH_TO_START : MSG_BATTLESHIP), 0, 0, BITMAP_ALIGN_LEFT, 1);
 
-    bitmap_render_font ((instruction_shown ? "Push to start" : "BattleShip!"), 0, 0, BITMAP_ALIGN_LEFT, 1);
+    if (debug_combo_check ()) return;
 
     if (navswitch_push_event_p (NAVSWITCH_PUSH)) {
-        instruction_shown = 0;
-        return state_place_ship_rotate_init ();
+        return set_game_state (STATE_PLACE_SHIP_ROTATE);
     }
 
     anim_ticks--;
     if (anim_ticks == 0) {
         if(instruction_shown) {
-            instruction_shown = 0;
-            state_intro_explosion_init ();
+            set_game_state (STATE_INTRO_EXPLOSION);
         } else {
             instruction_shown = 1;
-            anim_ticks = bitmap_get_font_ticks ("Push to start");
+            anim_ticks = MSG_PUSH_TO_START_TICKS;
         }
     }
 
 }
 
-// Counts the length of all ships and returns the total length.
-uint8_t get_total_ship_length (void)
+// Starts with the title again next time the intro text is shown
+void state_intro_text_exit (void)
 {
-    uint8_t i = 0;
-    uint8_t total = 0;
-    for (i = 0; i< SHIPS_COUNT; i++) {
-        total += player_ships[i].length;
-    }
-    return total;
+    instruction_shown = 0;
 }
 
-// Changes the game state to shot hit state, gets the amount of ticks needed for text to scroll across and increments shot hit count
-void state_shot_hit_init (void)
+// Gets the amount of ticks needed for the HIT! or SUNK! text to scroll across
+void state_shot_hit_enter (void)
 {
     led_off ();
-    game_state = STATE_SHOT_HIT;
-    anim_ticks = bitmap_get_font_ticks ("HIT!");
-    bitmap_reset_font_scroll ();
-
-    if (is_player_turn) {
-        my_hit_count++;
-    } else {
-        enemy_hit_count++;
-    }
+    anim_ticks = last_shot_sunk ? MSG_SUNK_TICKS : MSG_HIT_TICKS;
 }
 
-// Displays a scrolling text (HIT!) and changes to the other player's turn
+// Displays a scrolling text (HIT! or SUNK! if the shot sank a ship) and changes to the other player's turn
 void state_shot_hit_tick (void)
 {
-    bitmap_render_font ("HIT!", 0, 0, BITMAP_ALIGN_LEFT, 1);
-    anim_ticks--;
-    if (anim_ticks == 0) player_turn_toggle ();
+    bitmap_render_strip (last_shot_sunk ? MSG_SUNK : MSG_HIT, 0, 0, BITMAP_ALIGN_LEFT, TEXT_STATE_PERIOD);
+    anim_ticks -= TEXT_STATE_PERIOD;
+    if (anim_ticks <= 0) player_turn_toggle ();
 }
 
 // Changes to the other player's turn, also puts the current player to waiting state
 void player_turn_toggle (void)
 {
-    uint8_t total_length = get_total_ship_length ();
-
-    if (my_hit_count == total_length) {
-        return state_won_init ();
-    } else if (enemy_hit_count == total_length) {
-        return state_lost_init ();
+    if (enemy_ships_sunk == SHIPS_COUNT) {
+        return set_game_state (STATE_WON);
+    } else if (ships_lost == SHIPS_COUNT) {
+        return set_game_state (STATE_LOST);
     }
 
     is_player_turn = !is_player_turn;
 
     if (is_player_turn) {
-        state_choose_target_init ();
+        set_game_state (STATE_CHOOSE_TARGET);
     } else {
-        state_waiting_turn_init ();
+        set_game_state (STATE_WAITING_TURN);
     }
 }
 
-// Changes game state to shot miss state, determines the amount of ticks needed for the text
-void state_shot_miss_init (void)
+// Determines the amount of ticks needed for the text
+void state_shot_miss_enter (void)
 {
-    game_state = STATE_SHOT_MISS;
-    anim_ticks = bitmap_get_font_ticks ("MISS!");
-    bitmap_reset_font_scroll ();
+    anim_ticks = MSG_MISS_TICKS;
 }
 
 // Displays a scrolling text (MISS!) and changes to the other player's turn
 void state_shot_miss_tick (void)
 {
-    bitmap_render_font ("MISS!", 0, 0, BITMAP_ALIGN_LEFT, 1);
-    anim_ticks--;
-    if (anim_ticks == 0) player_turn_toggle ();
-}
-
-// True if the ships that are about to be placed intersect with a point of another ship, otherwise false
-bool ship_intersects_with_point (PlayerShip ship, uint8_t x, uint8_t y)
-{
-    uint8_t j;
-    for (j = 0; j < ship.length; j++) {
-        if (ship.x + (ship.vertical ? 0 : j) == x
-            && ship.y + (ship.vertical ? j : 0) == y) {
-            return 1;
-        }
-    }
-    return 0;
-}
-
-// True if the ships that are about to be placed intersect with another ship ,otherwise false
-bool ship_intersects_with_ship (PlayerShip ship1, PlayerShip ship2)
-{
-    uint8_t j;
-    for(j = 0; j < ship1.length; j++) {
-        uint8_t x = ship1.x + (ship1.vertical ? 0 : j);
-        uint8_t y = ship1.y + (ship1.vertical ? j : 0);
-        if (ship_intersects_with_point (ship2, x, y)) {
-            return 1;
-        }
-    }
-    return 0;
-}
-
-// Changes game state to waiting state
-void state_waiting_turn_init (void)
-{
-    game_state = STATE_WAITING_TURN;
-    bitmap_reset_font_scroll ();
+    bitmap_render_strip (MSG_MISS, 0, 0, BITMAP_ALIGN_LEFT, TEXT_STATE_PERIOD);
+    anim_ticks -= TEXT_STATE_PERIOD;
+    if (anim_ticks <= 0) player_turn_toggle ();
 }
 
 // Displays scrolling text (WAITING..), waits for a hit or miss request and takes in the coordinates to see if its a hit or miss
 // then changes the game state of both fun kits to shot hit state or shot miss state
 void state_waiting_turn_tick (void)
 {
-    bitmap_render_font ("Waiting..", 0, 0, BITMAP_ALIGN_LEFT, 1);
+    bitmap_render_strip (MSG_WAITING, 0, 0, BITMAP_ALIGN_LEFT, TEXT_STATE_PERIOD);
+    ai_take_turn ();
 
     if (ir_get_incoming_type () == PACKET_HITMISS_REQUEST) {
-        uint8_t target_x = ir_get_incoming_coords_x ();
-        uint8_t target_y = ir_get_incoming_coords_y ();
-        ir_clear_inbound_packet ();
-
-        uint8_t i;
-        bool has_hit_ship = 0;
-        for (i = 0; i < SHIPS_COUNT && !has_hit_ship; i++) {
-            if (ship_intersects_with_point (player_ships[i], target_x, target_y)) has_hit_ship = 1;
-        }
+        IrShotResult result;
 
-        ir_send_hit_miss_response (has_hit_ship);
+        // ircomms answered the shot as soon as it arrived, a request too short to answer is thrown away
+        bool answered = ir_get_incoming_answer (&result);
+        ir_clear_inbound_packet ();
+        if (!answered) return;
 
-        if (has_hit_ship) {
-            state_shot_hit_init ();
+        last_shot_sunk = result.sunk != 0;
+        if (result.hit) {
+            set_game_state (STATE_SHOT_HIT);
         } else {
-            state_shot_miss_init ();
+            set_game_state (STATE_SHOT_MISS);
         }
     }
 }
@@ -432,40 +567,58 @@ void state_waiting_turn_tick (void)
 // Checks if enemy has placed all their ships and clears inbound packet
 void check_enemy_placement (void)
 {
-    if (ir_get_incoming_type () == PACKET_SHIPS_PLACED && ir_get_incoming_bool ()) {
+    if (ir_get_incoming_type () == PACKET_SHIPS_PLACED) {
         enemy_has_placed_ships = 1;
         ir_clear_inbound_packet ();
     }
 }
 
-// Changes game state to won state and reset font scroll
-void state_won_init (void)
-{
-    game_state = STATE_WON;
-    bitmap_reset_font_scroll ();
-}
-
 // Displays scrolling text (WINNER!), if navswitch is pushed it will restart the game
 void state_won_tick (void)
 {
-    bitmap_render_font ("WINNER!", 0, 0, BITMAP_ALIGN_LEFT, 1);
+    bitmap_render_strip (MSG_WINNER, 0, 0, BITMAP_ALIGN_LEFT, 1);
     if (navswitch_push_event_p (NAVSWITCH_PUSH)) game_init ();
 }
 
-// Changes game state to lose state and reset font scroll
-void state_lost_init (void)
-{
-    game_state = STATE_LOST;
-    bitmap_reset_font_scroll ();
-}
-
 // Displays scrolling text (LOSER!), if navswitch is pushed it will restart the game
 void state_lost_tick (void)
 {
-    bitmap_render_font ("LOSER!", 0, 0, BITMAP_ALIGN_LEFT, 1);
+    bitmap_render_strip (MSG_LOSER, 0, 0, BITMAP_ALIGN_LEFT, 1);
     if (navswitch_push_event_p (NAVSWITCH_PUSH)) game_init ();
 }
 
+// Runs the current game state once and shows the frame it drew. States with a longer
+// period skip the ticks in between, leaving their last frame on the display
+void game_tick (void)
+{
+    ai_tick ();
+    if (!enemy_has_placed_ships) check_enemy_placement ();
+
+    // Nothing more is acknowledged while a packet sits in the inbound slot, so throw away any no state will ever read
+    uint8_t incoming = ir_get_incoming_type ();
+    if (incoming != PACKET_NULL && !(GAME_ACCEPTS & ACCEPTS (incoming))) {
+        ir_clear_inbound_packet ();
+    }
+
+    if (state_wait_ticks) {
+        state_wait_ticks--;
+        return;
+    }
+    state_wait_ticks = pgm_read_byte (&states[game_state].period) - 1;
+
+#ifdef PROFILE
+    // Time the tick against the state it started in
+    game_state_t ticked_state = game_state;
+#endif
+    PROFILE_BEGIN (start);
+
+    bitmap_clear ();
+    state_hook_call (&states[game_state].tick);
+    bitmap_swap ();
+
+    PROFILE_END (PROFILE_STATES + ticked_state, start);
+}
+
 // Initialises functions
 int main (void)
 {
@@ -474,54 +627,19 @@ int main (void)
     ledmatrix_init ();
     led_init ();
     navswitch_init ();
-    pacer_init (LOOP_RATE);
+    pacer_init (SCHEDULER_RATE);
+    bitmap_init ();
     ir_uart_init ();
+    ir_comms_init ();
 
     game_init ();
+    sei ();
 
-    //Infinite while loop to check which state the fun kits are in and performs the functions
-    while (1) {
-        pacer_wait ();
-        bitmap_clear ();
-        navswitch_update ();
-        ir_comms_tick ();
-
-        if (!enemy_has_placed_ships) check_enemy_placement ();
-
-        if (game_state == STATE_INTRO_EXPLOSION) {
-            state_intro_explosion_tick ();
-
-        } else if (game_state == STATE_INTRO_TEXT) {
-            state_intro_text_tick ();
-
-        } else if (game_state == STATE_PLACE_SHIP_ROTATE) {
-            state_place_ship_rotate_tick ();
-
-        } else if (game_state == STATE_PLACE_SHIP_MOVE) {
-            state_place_ship_move_tick ();
-
-        } else if (game_state == STATE_CHOOSE_TARGET) {
-            state_choose_target_tick ();
-
-        } else if (game_state == STATE_SHOT_HIT) {
-            state_shot_hit_tick ();
-
-        } else if (game_state == STATE_SHOT_MISS) {
-            state_shot_miss_tick ();
-
-        } else if (game_state == STATE_WAITING_TURN) {
-            state_waiting_turn_tick ();
-
-        } else if (game_state == STATE_WON) {
-            state_won_tick ();
-
-        } else if (game_state == STATE_LOST) {
-            state_lost_tick ();
-        }
-
-
-        bitmap_display();
-    }
+    // Each subsystem runs at its own rate, the display refreshes itself from the timer interrupt
+    scheduler_add (ir_comms_tick, IR_TICK_RATE);
+    scheduler_add (navswitch_update, INPUT_RATE);
+    scheduler_add (game_tick, GAME_TICK_RATE);
+    scheduler_run ();
 
     return 0;
 }
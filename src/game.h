@@ -11,8 +11,16 @@
 #define SHIPS_COUNT 3
 #define CENTRE_X 3
 #define CENTRE_Y 2
-#define EXPLOSION_ANIMATION_TICKS 1200
-#define SHIP_PLACEMENT_FLASH_TICKS 250
+
+// Task rates in runs per second. Input runs with the game so each navswitch push event is seen by exactly one state tick
+#define GAME_TICK_RATE 100
+#define INPUT_RATE GAME_TICK_RATE
+#define IR_TICK_RATE 1000
+
+// Durations in game ticks
+#define EXPLOSION_STEP_TICKS (GAME_TICK_RATE / 8)
+#define EXPLOSION_ANIMATION_TICKS (20 * EXPLOSION_STEP_TICKS)
+#define SHIP_PLACEMENT_FLASH_TICKS (GAME_TICK_RATE / 2)
 
 struct ship_s{
     uint8_t x;
@@ -20,6 +28,7 @@ struct ship_s{
     uint8_t length;
     bool vertical;
     bool placed;
+    uint8_t damage;     // Bit i is set once the cell i along the ship has been hit
 };
 
 typedef struct ship_s PlayerShip;
@@ -35,13 +44,16 @@ typedef enum
     STATE_SHOT_MISS,            // Shot missed message
     STATE_WAITING_TURN,         // Waiting for the other player to fire
     STATE_WON,                  // Won game screen
-    STATE_LOST                  // Lost game screen
+    STATE_LOST,                 // Lost game screen
+    STATE_DEBUG_IR,             // IR link counters
+    STATE_DEBUG_PROFILE,        // Loop timings, only in PROFILE builds
+    GAME_STATES_NUM
 } game_state_t;
 
 // Initialises the variables and resets ship placements, hits and misses count
 void game_init (void);
 
-// Allows other modules to change the game state
+// Allows other modules to change the game state, running the exit hook of the old state and the enter hook of the new one
 void set_game_state (game_state_t state);
 
 // Checks if a particular coordinate has been guessed
@@ -56,64 +68,66 @@ bool coords_have_been_missed (uint8_t x, uint8_t y);
 // Sets the hit/miss status of a coordinate
 void set_coords_hitmiss (uint8_t x, uint8_t y, bool hit);
 
-// Changes game state to ship roatate state
+// Returns the length of one of the ships each player places
+uint8_t get_ship_length (uint8_t index);
+
+// Checks if x, y is part of an enemy ship the player has sunk
+bool coords_are_sunk (uint8_t x, uint8_t y);
+
+// Marks an enemy ship length long starting at x, y as sunk, the last shot is shown as sinking it
+void set_enemy_ship_sunk (uint8_t x, uint8_t y, uint8_t length, bool vertical);
+
 // Allows ships to be rotated vertically or horizontally,
 // push up or down on the navswitch to make the ship vertical and left or right for horizantal
-void state_place_ship_rotate_init (void);
 void state_place_ship_rotate_tick (void);
 
-// Changes game state to placing ship state
-// Allows ships to be moved around the led matrix. Will not let you place a ship it will intersect with another ship
-// Renders an individual player ship to the bitmap
-void state_place_ship_move_init (void);
+// Works out every position the ship about to be moved could be placed at, given the ships already placed
+// Allows ships to be moved around the led matrix. Will not let you place a ship it will intersect with another ship,
+// positions where it can't go are skipped and shown dimmed
+// Renders an individual player ship to the bitmap at the given intensity
+void state_place_ship_move_enter (void);
 void state_place_ship_move_tick (void);
-void player_ship_render (PlayerShip ship, bool do_flash);
+void player_ship_render (PlayerShip ship, bool do_flash, uint8_t intensity);
 
-// Sets the amount of ticks for the animation and sets the game state to intro explosion state
+// Sets the amount of ticks for the animation
 // Displays the explosion 3 times then displays the intro text, if button is pushed down, game state will change to rotating ship state
-void state_intro_explosion_init (void);
+void state_intro_explosion_enter (void);
 void state_intro_explosion_tick (void);
 
-// Determines the amount of ticks for the intro text, changes game state to intro text state and resets the scroll
+// Determines the amount of ticks for the intro text
 // Displays a scrolling intro text (Name of the game and instruction to start the game), if navswitch is pushed it will change to ship rotation selection state
-void state_intro_text_init (void);
+// Starts with the title again next time the intro text is shown
+void state_intro_text_enter (void);
 void state_intro_text_tick (void);
+void state_intro_text_exit (void);
 
-// Changes the game state to shot hit state, gets the amount of ticks needed for text to scroll across and increments shot hit count
-// Displays a scrolling text (HIT!) and changes to the other player's turn
+// Gets the amount of ticks needed for the HIT! or SUNK! text to scroll across
+// Displays a scrolling text (HIT! or SUNK! if the shot sank a ship) and changes to the other player's turn
 // Changes to the other player's turn, also puts the current player to waiting state
-void state_shot_hit_init (void);
+void state_shot_hit_enter (void);
 void state_shot_hit_tick (void);
 void player_turn_toggle (void);
 
-// Changes game state to shot miss state, determines the amount of ticks needed for the text
+// Determines the amount of ticks needed for the text
 // Displays a scrolling text (MISS!) and changes to the other player's turn
-void state_shot_miss_init (void);
+void state_shot_miss_enter (void);
 void state_shot_miss_tick (void);
 
-// True if the ships that are about to be placed intersect with a point of another ship, otherwise false
-// True if the ships that are about to be placed intersect with another ship ,otherwise false
-bool ship_intersects_with_point (PlayerShip ship, uint8_t x, uint8_t y);
-bool ship_intersects_with_ship (PlayerShip ship1, PlayerShip ship2);
-
-// Changes game state to waiting state
 // Displays scrolling text (WAITING..), waits for a hit or miss request and takes in the coordinates to see if its a hit or miss
 // then changes the game state of both fun kits to shot hit state or shot miss state
-void state_waiting_turn_init (void);
 void state_waiting_turn_tick (void);
 
-// Changes game state to lose state and reset font scroll
 // Displays scrolling text (LOSER!), if navswitch is pushed it will restart the game
-void state_lost_init (void);
 void state_lost_tick (void);
 
-// Changes game state to won state and reset font scroll
 // Displays scrolling text (WINNER!), if navswitch is pushed it will restart the game
-void state_won_init (void);
 void state_won_tick (void);
 
 // Checks if enemy has placed all their ships and clears inbound packet
 void check_enemy_placement (void);
 
+// Runs the current game state once and shows the frame it drew, states with a longer period skip the ticks in between
+void game_tick (void);
+
 int main (void);
 #endif
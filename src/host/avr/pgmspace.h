@@ -0,0 +1,14 @@
+/*
+# File:   pgmspace.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   22 Oct 2017
+# Descr:  Stand-in for avr/pgmspace.h so flash tables build for host tools, they are read like any other memory
+*/
+
+#ifndef PGMSPACE_H
+#define PGMSPACE_H
+
+#define PROGMEM
+#define pgm_read_byte(ADDRESS) (*(const uint8_t*) (ADDRESS))
+
+#endif
@@ -0,0 +1,14 @@
+/*
+# File:   system.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Stand-in for drivers/avr/system.h so the font code builds for host tools
+*/
+
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#endif
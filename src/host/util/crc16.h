@@ -0,0 +1,24 @@
+/*
+# File:   crc16.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   22 Oct 2017
+# Descr:  Stand-in for util/crc16.h so the frame code builds for host tools, the same CRC-8 as avr-libc
+*/
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+// CRC-8 with polynomial x^8 + x^2 + x + 1, one byte at a time
+static inline uint8_t _crc8_ccitt_update (uint8_t crc, uint8_t data)
+{
+    uint8_t i;
+    crc ^= data;
+    for (i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,214 @@
+/*
+# File:   irbulk.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Selective repeat sliding window transfers of larger blocks of data over ir.
+#         Only built into the firmware with "make IRBULK=1"
+*/
+
+#include <string.h>
+#include "system.h"
+#include "ircomms.h"
+#include "irbulk.h"
+#include "game.h"
+
+#ifdef IRBULK
+
+#define SEQ_MASK 0x0F
+#define SLOT(FRAME) ((FRAME) & (IRBULK_WINDOW_MAX - 1))
+
+// Sending side. Frames are numbered from 0 in each transfer, frame i has sequence number
+// (tx_seq_start + i) and carries the payload bytes from i * IRFRAME_PAYLOAD_MAX
+static const uint8_t* tx_data = NULL;
+static uint16_t tx_length = 0;
+static uint16_t tx_frames = 0;
+static uint16_t tx_base = 0;            // First frame not yet acknowledged
+static uint16_t tx_next = 0;            // Next frame to send for the first time
+static uint8_t tx_seq_start = 0;
+static uint8_t tx_seq = 0;              // Sequence number the next transfer starts at
+static uint8_t tx_window = IRBULK_WINDOW_MAX;
+static uint8_t tx_acked = 0;            // Bit k set once frame tx_base + k has been acknowledged
+static uint8_t tx_resent = 0;           // Bit k set once frame tx_base + k has been sent more than once
+static uint16_t tx_sent_at[IRBULK_WINDOW_MAX];
+static int16_t tx_sending = -1;         // Frame being written to the UART
+
+static uint16_t bulk_clock = 0;
+static uint16_t tx_start = 0;
+static uint16_t throughput = 0;
+
+// Receiving side. Frames are written straight into the buffer at their place in the stream,
+// which works because every frame but the last of a transfer is full
+static uint8_t* rx_buffer = NULL;
+static uint16_t rx_size = 0;
+static uint16_t rx_received = 0;
+static uint8_t rx_next_seq = 0;         // Sequence number of the next frame to be delivered in order
+static uint8_t rx_have = 0;             // Bit k set once frame rx_next_seq + k has been stored
+static uint8_t rx_lengths[IRBULK_WINDOW_MAX];
+static bool rx_ack_pending = 0;
+
+// Starts sending length bytes from data, which must stay unchanged until the transfer is done.
+// Returns false if a transfer is already running
+bool ir_bulk_send (const uint8_t* data, uint16_t length)
+{
+    if(tx_data || !length) return 0;
+
+    tx_data = data;
+    tx_length = length;
+    tx_frames = (length + IRFRAME_PAYLOAD_MAX - 1) / IRFRAME_PAYLOAD_MAX;
+    tx_base = 0;
+    tx_next = 0;
+    tx_seq_start = tx_seq;
+    tx_acked = 0;
+    tx_resent = 0;
+    tx_sending = -1;
+    tx_start = bulk_clock;
+    return 1;
+}
+
+// True while a transfer is being sent
+bool ir_bulk_busy (void)
+{
+    return tx_data != NULL;
+}
+
+// Sets the number of frames that can be in flight at once, from 1 to IRBULK_WINDOW_MAX
+void ir_bulk_set_window (uint8_t window)
+{
+    if(window < 1) window = 1;
+    if(window > IRBULK_WINDOW_MAX) window = IRBULK_WINDOW_MAX;
+    tx_window = window;
+}
+
+// Gives the buffer received bytes are written to in order, and clears the received count
+void ir_bulk_set_receiver (uint8_t* buffer, uint16_t size)
+{
+    rx_buffer = buffer;
+    rx_size = size;
+    rx_received = 0;
+}
+
+// Returns the number of bytes received in order so far
+uint16_t ir_bulk_get_received (void)
+{
+    return rx_received;
+}
+
+// Returns the bytes per second of the last completed transfer
+uint16_t ir_bulk_get_throughput (void)
+{
+    return throughput;
+}
+
+// Stores a data frame that falls inside the receive window, then delivers every frame that is now in order.
+// Frames behind the window were delivered already and are only acknowledged again
+void ir_bulk_receive (const IrFrame* frame)
+{
+    if(frame->type == IRBULK_ACK) {
+        if(!tx_data) return;
+
+        // The sequence number is the next frame the receiver wants, so every frame before it has arrived
+        uint8_t advanced = (frame->seq - (tx_seq_start + tx_base)) & SEQ_MASK;
+        if(advanced > tx_next - tx_base) return;
+
+        tx_base += advanced;
+        tx_acked >>= advanced;
+        tx_resent >>= advanced;
+
+        // Then bit j of the payload is the frame j + 1 after it
+        uint8_t in_flight = tx_next - tx_base;
+        if(frame->length) tx_acked |= (frame->payload[0] << 1) & ((1 << in_flight) - 1);
+
+        if(tx_base == tx_frames) {
+            uint16_t ticks = bulk_clock - tx_start;
+            throughput = (uint32_t) tx_length * IR_TICK_RATE / (ticks ? ticks : 1);
+            tx_seq = (tx_seq_start + tx_frames) & SEQ_MASK;
+            tx_data = NULL;
+        }
+        return;
+    }
+
+    uint8_t offset = (frame->seq - rx_next_seq) & SEQ_MASK;
+    if(offset < IRBULK_WINDOW_MAX && rx_buffer && !(rx_have & (1 << offset))) {
+        uint16_t pos = rx_received + offset * IRFRAME_PAYLOAD_MAX;
+        if(pos + frame->length > rx_size) return;
+
+        memcpy (rx_buffer + pos, frame->payload, frame->length);
+        rx_lengths[SLOT (frame->seq)] = frame->length;
+        rx_have |= (1 << offset);
+
+        while(rx_have & 1) {
+            rx_received += rx_lengths[SLOT (rx_next_seq)];
+            rx_next_seq = (rx_next_seq + 1) & SEQ_MASK;
+            rx_have >>= 1;
+        }
+    }
+
+    rx_ack_pending = 1;
+}
+
+// Fills in a cumulative acknowledgement with a bitmap of the frames stored past it, returns false if none is needed
+bool ir_bulk_next_ack (IrFrame* frame)
+{
+    if(!rx_ack_pending) return 0;
+
+    frame->type = IRBULK_ACK;
+    frame->seq = rx_next_seq;
+    frame->length = 1;
+    frame->payload[0] = rx_have >> 1;
+    rx_ack_pending = 0;
+    return 1;
+}
+
+// Fills in the frame to send next: the oldest frame whose acknowledgement is overdue, otherwise
+// the next new frame if the window has room. Returns false if none is due
+bool ir_bulk_next_data (IrFrame* frame)
+{
+    if(!tx_data) return 0;
+
+    uint16_t rto = ir_get_rto ();
+    uint16_t i;
+    int16_t due = -1;
+
+    for(i = tx_base; i < tx_next && due < 0; i++) {
+        uint8_t bit = 1 << (i - tx_base);
+        if(tx_acked & bit) continue;
+
+        // A frame that was already resent waits twice as long
+        uint16_t timeout = (tx_resent & bit) ? rto << 1 : rto;
+        if((uint16_t) (bulk_clock - tx_sent_at[SLOT (i)]) >= timeout) {
+            tx_resent |= bit;
+            due = i;
+        }
+    }
+
+    if(due < 0 && tx_next < tx_frames && tx_next - tx_base < tx_window) due = tx_next++;
+    if(due < 0) return 0;
+
+    uint16_t offset = due * IRFRAME_PAYLOAD_MAX;
+    uint8_t length = (tx_length - offset < IRFRAME_PAYLOAD_MAX) ? tx_length - offset : IRFRAME_PAYLOAD_MAX;
+
+    frame->type = IRBULK_DATA;
+    frame->seq = (tx_seq_start + due) & SEQ_MASK;
+    frame->length = length;
+    memcpy (frame->payload, tx_data + offset, length);
+
+    // Not timed out again before it has finished being sent
+    tx_sending = due;
+    tx_sent_at[SLOT (due)] = bulk_clock;
+    return 1;
+}
+
+// The timeout of a frame runs from its last byte
+void ir_bulk_data_sent (void)
+{
+    if(tx_sending >= tx_base && tx_sending < tx_next) tx_sent_at[SLOT (tx_sending)] = bulk_clock;
+    tx_sending = -1;
+}
+
+// Advances the transfer bulk_clock by one tick
+void ir_bulk_tick (void)
+{
+    bulk_clock++;
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+# File:   irbulk.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Header file for irbulk.c. Bulk transfers are only built in when IRBULK is defined,
+#         otherwise the ircomms hooks compile to nothing
+*/
+
+#ifndef IRBULK_H
+#define IRBULK_H
+
+#include "irframe.h"
+
+// Frame types used by bulk transfers, next to the ircomms packet types
+#define IRBULK_DATA 0x0D
+#define IRBULK_ACK  0x0E
+
+// Most frames in flight at once, half the sequence numbers so old and new frames can't be confused
+#define IRBULK_WINDOW_MAX 8
+
+#ifdef IRBULK
+
+// Starts sending length bytes from data, which must stay unchanged until the transfer is done.
+// Returns false if a transfer is already running
+bool ir_bulk_send (const uint8_t* data, uint16_t length);
+
+// True while a transfer is being sent
+bool ir_bulk_busy (void);
+
+// Sets the number of frames that can be in flight at once, from 1 to IRBULK_WINDOW_MAX
+void ir_bulk_set_window (uint8_t window);
+
+// Gives the buffer received bytes are written to in order, and clears the received count
+void ir_bulk_set_receiver (uint8_t* buffer, uint16_t size);
+
+// Returns the number of bytes received in order so far
+uint16_t ir_bulk_get_received (void);
+
+// Returns the bytes per second of the last completed transfer
+uint16_t ir_bulk_get_throughput (void);
+
+// Used by ircomms: handles a bulk frame with a good CRC
+void ir_bulk_receive (const IrFrame* frame);
+
+// Used by ircomms: fills in the acknowledgement to send next, returns false if none is needed
+bool ir_bulk_next_ack (IrFrame* frame);
+
+// Used by ircomms: fills in the data frame to send next, returns false if none is due
+bool ir_bulk_next_data (IrFrame* frame);
+
+// Used by ircomms: the last data frame from ir_bulk_next_data has all been written to the UART
+void ir_bulk_data_sent (void);
+
+// Used by ircomms: advances the transfer clock by one tick, timeouts are ir_get_rto ticks
+void ir_bulk_tick (void);
+
+#else
+
+#define ir_bulk_receive(FRAME) ((void) (FRAME))
+#define ir_bulk_next_ack(FRAME) ((void) (FRAME), 0)
+#define ir_bulk_next_data(FRAME) ((void) (FRAME), 0)
+#define ir_bulk_data_sent() ((void) 0)
+#define ir_bulk_tick() ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+/*
+# File:   irbulk_bench.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   22 Oct 2017
+# Descr:  Host benchmark for bulk IR transfers. irbulk and irframe are run against a simulated
+#         half duplex link that loses frames and flips bits, and the throughput is printed for
+#         every window size. Run with "make bench"
+*/
+
+// Bulk transfers are what is being measured, whatever the firmware build leaves out
+#ifndef IRBULK
+#define IRBULK
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "system.h"
+#include "game.h"
+#include "ircomms.h"
+#include "irframe.h"
+#include "irbulk.h"
+
+// Bytes sent in each transfer
+#define BENCH_BYTES 256
+
+// Give up on a transfer after this many ticks
+#define BENCH_TICKS_MAX 60000
+
+// Timeout the sender uses, the starting one ircomms uses before it has measured the round trip
+#define BENCH_RTO (2 * (IRFRAME_BYTES_MAX + IRFRAME_WIRE_BYTES (1)) * IR_BYTE_TICKS)
+
+// Percentage of frames lost outright, as when the kits are pointed away from each other
+static const uint8_t loss_rates[] = {0, 5, 10, 20, 30};
+
+// Chance in 1000 of each byte on the wire having one bit flipped, the Hamming code corrects these
+#define BIT_ERRORS_PER_1000 10
+
+static uint32_t random_state = 1;
+
+// The simulated link always uses the starting timeout
+uint16_t ir_get_rto (void)
+{
+    return BENCH_RTO;
+}
+
+// Xorshift random numbers, the same sequence on every run
+static uint32_t bench_random (void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// Sends one transfer through the link, the same irbulk both sends and receives it. Data frames and
+// acknowledgements share the wire one frame at a time, acknowledgements first as in ircomms.
+// Returns the throughput in bytes per second, or 0 if the data didn't arrive intact in time
+static uint16_t bench_transfer (uint8_t window, uint8_t loss)
+{
+    static uint8_t data[BENCH_BYTES];
+    static uint8_t received[BENCH_BYTES];
+    uint8_t wire[IRFRAME_BYTES_MAX];
+    uint8_t wire_length = 0;
+    uint16_t wire_ticks = 0;
+    bool wire_data = 0;
+    IrFrameParser parser;
+    IrFrame frame;
+    uint16_t i;
+    uint32_t tick;
+
+    for (i = 0; i < BENCH_BYTES; i++) data[i] = bench_random ();
+    memset (received, 0, sizeof (received));
+    irframe_parser_reset (&parser);
+
+    ir_bulk_set_window (window);
+    ir_bulk_set_receiver (received, sizeof (received));
+    ir_bulk_send (data, sizeof (data));
+
+    for (tick = 0; tick < BENCH_TICKS_MAX && ir_bulk_busy (); tick++) {
+        if (!wire_ticks) {
+            wire_data = 0;
+            if (ir_bulk_next_ack (&frame)) {
+                wire_length = irframe_encode (&frame, wire);
+            } else if (ir_bulk_next_data (&frame)) {
+                wire_length = irframe_encode (&frame, wire);
+                wire_data = 1;
+            } else {
+                wire_length = 0;
+            }
+            wire_ticks = wire_length * IR_BYTE_TICKS;
+        }
+
+        ir_bulk_tick ();
+        if (!wire_ticks || --wire_ticks) continue;
+
+        // The last byte is out, the frame arrives whole or not at all
+        if (wire_data) ir_bulk_data_sent ();
+        if (bench_random () % 100 < loss) continue;
+
+        for (i = 0; i < wire_length; i++) {
+            uint8_t byte = wire[i];
+            if (bench_random () % 1000 < BIT_ERRORS_PER_1000) byte ^= 1 << (bench_random () % 8);
+            if (irframe_parse (&parser, byte)) ir_bulk_receive (&parser.frame);
+        }
+    }
+
+    if (ir_bulk_busy () || ir_bulk_get_received () != BENCH_BYTES || memcmp (data, received, BENCH_BYTES)) return 0;
+    return ir_bulk_get_throughput ();
+}
+
+int main (void)
+{
+    uint8_t window;
+    uint8_t i;
+    bool failed = 0;
+
+    printf ("Bytes per second sending %d bytes at %d baud, one byte in %d with a bit flipped\n",
+            BENCH_BYTES, IR_BAUD_RATE, 1000 / BIT_ERRORS_PER_1000);
+    printf ("loss ");
+    for (window = 1; window <= IRBULK_WINDOW_MAX; window++) printf ("  w%d", window);
+    printf ("\n");
+
+    for (i = 0; i < sizeof (loss_rates); i++) {
+        printf ("%3d%% ", loss_rates[i]);
+        for (window = 1; window <= IRBULK_WINDOW_MAX; window++) {
+            uint16_t throughput = bench_transfer (window, loss_rates[i]);
+            if (!throughput) failed = 1;
+            printf (" %3d", throughput);
+        }
+        printf ("\n");
+    }
+
+    // A transfer that didn't arrive intact shows as 0
+    return failed;
+}
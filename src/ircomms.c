@@ -5,148 +5,639 @@
 # Descr:  Allows reliable transmissions of boolean and coordinate values over ir
 */
 
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <string.h>
+#include "system.h"
 #include "ir_uart.h"
 #include "ircomms.h"
+#include "irframe.h"
+#include "irbulk.h"
+#include "game.h"
 #include "led.h"
 
-#define ID_BITS      0xB0
-#define ID_MASK      0xF0
-#define TYPE_MASK    ~ID_MASK
+// Frame type of an acknowledgement, its sequence number is the one of the frame it acknowledges
+#define PACKET_ACK 0x0F
+#define SEQ_MASK   0x0F
 
-#define ACK_BITS     0xAC
+// Session announcement, payload: [NONCE HIGH] [NONCE LOW] [SLOT TICK HIGH] [SLOT TICK LOW]
+#define PACKET_HELLO 0x0C
+#define HELLO_LENGTH 4
 
-#define DATA_ID_BITS 0x40
-#define DATA_ID_MASK 0b11000000
-#define DATA_MASK    ~DATA_ID_MASK
+// Hit/miss response payload: [X] [Y] [FLAGS] [SUNK], SUNK is [VERTICAL:1|OFFSET:3|LENGTH:4]
+#define RESPONSE_HIT       0x01
+#define RESPONSE_GAME_OVER 0x02
+#define RESPONSE_SUNK_LENGTH       0x0F
+#define RESPONSE_SUNK_OFFSET_SHIFT 4
+#define RESPONSE_SUNK_OFFSET       0x70
+#define RESPONSE_SUNK_VERTICAL     0x80
 
-static uint8_t outbound_packet_type_bits = 0;
-static uint8_t outbound_data_bits = 0;
+// Packets waiting to be sent, the packet at tx_head is resent until the other kit acknowledges it.
+// Only one packet is in flight at a time so they arrive in order
+#define TX_QUEUE_SIZE 4
 
-static ir_packet_t inbound_packet_type = 0;
-static uint8_t inbound_data = 0;
+static IrFrame tx_queue[TX_QUEUE_SIZE];
+static uint8_t tx_head = 0;
+static uint8_t tx_count = 0;
+static uint8_t tx_next_seq = 0;
+
+// Progress of the packet at the head of the queue
+enum
+{
+    TX_DUE,         // Waiting for the wire to be free
+    TX_SENDING,     // Its bytes are being written to the UART
+    TX_WAITING      // Sent, waiting for an acknowledgement or the timeout
+};
+
+static uint8_t tx_state = TX_DUE;
+
+// Bytes of the frame being written to the UART, one byte each tick
+static uint8_t wire[IRFRAME_BYTES_MAX];
+static uint8_t wire_length = 0;
+static uint8_t wire_pos = 0;
+static bool wire_bulk_data = 0;    // The wire holds a bulk data frame
+
+// Acknowledgement to send once the wire is free
+static bool ack_pending = 0;
+static uint8_t ack_seq = 0;
+
+static IrFrameParser parser;
+
+// Sequence number of the last packet delivered, a packet with the same number is a resend of it.
+// Starts out of range so the first packet is always new
+static uint8_t rx_last_seq = 0xFF;
+
+static IrFrame inbound;
 static bool inbound_ready = 0;
 
-static uint8_t comms_tick = 0;
+// Answers shot requests as soon as they arrive, and the answer it gave to the request in the inbound slot
+static ir_shot_handler_t shot_handler = NULL;
+static IrShotResult inbound_answer;
+static bool inbound_answered = 0;
+
+// Takes the packets this kit sends in place of the other kit, NULL when playing over IR
+static ir_local_peer_t local_peer = NULL;
+
+// Retransmission timeout limits in ticks, timed from the last byte of a frame. The first timeout
+// allows for the other kit finishing a frame of its own before sending the acknowledgement
+#define RTO_INITIAL (2 * (IRFRAME_BYTES_MAX + IRFRAME_WIRE_BYTES (0)) * IR_BYTE_TICKS)
+#define RTO_MIN (2 * IRFRAME_WIRE_BYTES (0) * IR_BYTE_TICKS)
+#define RTO_MAX 500
+#define RTO_BACKOFF_MAX 4
+
+// Ticks since the packet at the head of the queue was last sent
+static uint16_t comms_tick = 0;
+
+// Smoothed round trip time scaled by 8 and its mean deviation scaled by 4, 0 until the first sample
+static uint16_t srtt_x8 = 0;
+static uint16_t rttvar_x4 = 0;
+static uint16_t rto = RTO_INITIAL;
+
+// Timeout of the current send of the head packet and how many times it has been resent
+static uint16_t tx_timeout = RTO_INITIAL;
+static uint8_t tx_retries = 0;
+
+static IrStats link_stats;
+static uint16_t jitter_state = 1;
+
+// Once both kits have heard each other's hello the one with the lower nonce becomes the master.
+// The transmit period is split into two slots, the master sends only in the first and the other
+// kit only in the second, so they never talk over each other. Each slot fits the longest frame
+#define SLOT_GUARD_TICKS (2 * IR_BYTE_TICKS)
+#define SLOT_TICKS (IRFRAME_BYTES_MAX * IR_BYTE_TICKS + SLOT_GUARD_TICKS)
+#define SLOT_PERIOD (2 * SLOT_TICKS)
+
+// Hellos are sent about this often, the session ends if nothing is heard from the other kit for SESSION_TIMEOUT ticks
+#define HELLO_TICKS 500
+#define SESSION_TIMEOUT 2000
+
+// Without a session a frame starts only after the line has been quiet for a random number of ticks in this range
+#define BACKOFF_MIN IR_BYTE_TICKS
+#define BACKOFF_RANGE (4 * IR_BYTE_TICKS)
+
+enum
+{
+    SESSION_NONE,
+    SESSION_MASTER,
+    SESSION_SLAVE
+};
+
+static uint8_t session = SESSION_NONE;
+static uint16_t session_nonce = 0;
+static uint16_t peer_nonce = 0;
+static uint16_t session_quiet = 0;      // Ticks since the last frame from the other kit
+static uint16_t hello_tick = HELLO_TICKS;
+static bool hello_pending = 0;
+static uint8_t slot_tick = 0;           // Position in the slot period, lined up with the master's
+static uint8_t line_quiet = 0;          // Ticks since a byte was last received
+static uint8_t backoff = BACKOFF_MIN;
+
+// Received bytes waiting to be processed, the receive interrupt only writes rx_head and
+// ir_comms_tick only writes rx_tail. Both count up freely and are masked when indexing,
+// so the size must be a power of two that divides 256
+#define RX_BUFFER_SIZE 32
+#define RX_BUFFER_MASK (RX_BUFFER_SIZE - 1)
+
+#if RX_BUFFER_SIZE & RX_BUFFER_MASK
+#error RX_BUFFER_SIZE must be a power of two
+#endif
+
+static volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+static volatile uint16_t rx_dropped = 0;
+
+// Copies each received byte into the ring buffer so none are overwritten in the USART while a long game tick runs
+ISR(USART1_RX_vect)
+{
+    uint8_t head = rx_head;
+    uint8_t recv_data = UDR1;
+
+    if((uint8_t) (head - rx_tail) >= RX_BUFFER_SIZE) {
+        if(rx_dropped < 0xFFFF) rx_dropped++;
+        return;
+    }
+
+    rx_buffer[head & RX_BUFFER_MASK] = recv_data;
+    rx_head = head + 1;
+}
+
+// Enables the receive interrupt, must be called after ir_uart_init
+void ir_comms_init (void)
+{
+    rx_head = 0;
+    rx_tail = 0;
+    rx_dropped = 0;
+    irframe_parser_reset (&parser);
+    UCSR1B |= (1 << RXCIE1);
+}
+
+// Copies the link counters into stats
+void ir_get_stats (IrStats* stats)
+{
+    *stats = link_stats;
+    stats->corrected = parser.corrected;
+    stats->uncorrectable = parser.uncorrectable;
+    stats->crc_errors = parser.crc_errors;
+    stats->length_errors = parser.length_errors;
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+        stats->dropped = rx_dropped;
+    }
+}
+
+// Clears the link counters
+void ir_clear_stats (void)
+{
+    memset (&link_stats, 0, sizeof (link_stats));
+    parser.corrected = 0;
+    parser.uncorrectable = 0;
+    parser.crc_errors = 0;
+    parser.length_errors = 0;
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+        rx_dropped = 0;
+    }
+}
+
+// Adds one to a counter, stopping at its largest value
+static void ir_stat_add (uint16_t* counter)
+{
+    if(*counter < 0xFFFF) (*counter)++;
+}
+
+// Counts an acknowledgement latency into the histogram, buckets double in width from IR_LATENCY_FIRST ticks
+static void ir_stat_latency (uint16_t ticks)
+{
+    uint8_t bucket = 0;
+    uint16_t limit = IR_LATENCY_FIRST;
+
+    while(bucket < IR_LATENCY_BUCKETS - 1 && ticks >= limit) {
+        bucket++;
+        limit <<= 1;
+    }
+    ir_stat_add (&link_stats.latency[bucket]);
+}
+
+// Returns the current retransmission timeout in ticks
+uint16_t ir_get_rto (void)
+{
+    return rto;
+}
+
+// Returns the smoothed round trip time in ticks, 0 until a packet has been acknowledged
+uint16_t ir_get_srtt (void)
+{
+    return srtt_x8 >> 3;
+}
+
+// Xorshift random numbers for the resend jitter. The free running timer is mixed in so
+// two kits that start in step still pick different delays
+static uint16_t ir_comms_random (void)
+{
+    uint16_t x = jitter_state ^ TCNT1;
+    if(!x) x = 1;
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    jitter_state = x;
+    return x;
+}
+
+// Timeout for the next send of the head packet, doubled for each resend and with up to a quarter added at random
+static uint16_t ir_comms_timeout (void)
+{
+    uint16_t timeout = rto << (tx_retries < RTO_BACKOFF_MAX ? tx_retries : RTO_BACKOFF_MAX);
+    if(timeout > RTO_MAX) timeout = RTO_MAX;
+    return timeout + ir_comms_random () % ((timeout >> 2) + 1);
+}
+
+// Updates the smoothed round trip time and timeout with a new sample, as in Jacobson's algorithm
+static void ir_comms_rtt_sample (uint16_t rtt)
+{
+    if(!srtt_x8) {
+        srtt_x8 = rtt << 3;
+        rttvar_x4 = rtt << 1;
+    } else {
+        int16_t error = rtt - (srtt_x8 >> 3);
+        srtt_x8 += error;
+        if(error < 0) error = -error;
+        rttvar_x4 += error - (rttvar_x4 >> 2);
+    }
+
+    rto = (srtt_x8 >> 3) + rttvar_x4;
+    if(rto < RTO_MIN) rto = RTO_MIN;
+    if(rto > RTO_MAX) rto = RTO_MAX;
+}
+
+// Picks this kit's nonce the first time it is needed. The timer is read when the first hello is sent or
+// heard, which depends on when the player started the kit, so the two kits won't pick the same
+static void ir_comms_pick_nonce (void)
+{
+    if(!session_nonce) session_nonce = ir_comms_random ();
+}
+
+// Ends the session, sending falls back to random backoff until hellos are exchanged again
+static void ir_comms_session_end (void)
+{
+    if(session != SESSION_NONE) ir_stat_add (&link_stats.session_drops);
+    session = SESSION_NONE;
+}
+
+// Handles a hello from the other kit. A nonce that changes means the other kit restarted, so the
+// session is agreed again. Both kits then compare nonces the same way and pick opposite roles.
+// The master's hello carries its slot tick, which the other kit copies to line up its slots
+static void ir_comms_hello (const IrFrame* frame)
+{
+    if(frame->length < HELLO_LENGTH) return;
+    ir_comms_pick_nonce ();
+
+    uint16_t nonce = (frame->payload[0] << 8) | frame->payload[1];
+    uint16_t tick = (frame->payload[2] << 8) | frame->payload[3];
+
+    if(nonce != peer_nonce) {
+        // Forget the last packet from a kit that restarted, its sequence numbers start again
+        if(peer_nonce) rx_last_seq = 0xFF;
+        peer_nonce = nonce;
+        ir_comms_session_end ();
+    }
+
+    if(session == SESSION_NONE) {
+        if(nonce == session_nonce) {
+            // Both picked the same nonce, pick again. This runs when a frame arrives so the kits won't stay in step
+            session_nonce = ir_comms_random ();
+        } else {
+            session = (session_nonce < nonce ? SESSION_MASTER : SESSION_SLAVE);
+        }
+        hello_pending = 1;
+    }
+
+    // The master's slot tick was read as its frame started, add the time the frame took to arrive
+    if(session == SESSION_SLAVE) slot_tick = (tick + 1 + IRFRAME_WIRE_BYTES (HELLO_LENGTH) * IR_BYTE_TICKS) % SLOT_PERIOD;
+}
+
+// Returns the number of bytes that can be sent starting now
+static uint8_t ir_comms_room (void)
+{
+    if(session == SESSION_NONE) return (line_quiet >= backoff ? 0xFF : 0);
 
-// Sends data in a packet and turns led on when there is activity using the infared
-void ir_comms_send (ir_packet_t packet_type, uint8_t data)
+    uint8_t start = (session == SESSION_MASTER ? 0 : SLOT_TICKS);
+    if(slot_tick < start || slot_tick >= start + SLOT_TICKS - 1) return 0;
+    return (start + SLOT_TICKS - 1 - slot_tick) / IR_BYTE_TICKS;
+}
+
+// Starts sending the packet now at the head of the queue
+static void ir_comms_start_packet (void)
 {
-    outbound_packet_type_bits = ID_BITS | (packet_type & 0x0F);
-    outbound_data_bits = (DATA_ID_BITS & DATA_ID_MASK) | data;
-    comms_tick = 0;
+    tx_state = TX_DUE;
+    tx_retries = 0;
+    tx_timeout = ir_comms_timeout ();
+}
+
+// Queues a packet with up to IRFRAME_PAYLOAD_MAX bytes of payload and turns led on when there is activity using the infared.
+// Returns false if the queue is full and the packet was not queued
+bool ir_comms_send (ir_packet_t packet_type, const uint8_t* payload, uint8_t length)
+{
+    if(local_peer) {
+        local_peer (packet_type, payload, length);
+        return 1;
+    }
+
+    if(tx_count >= TX_QUEUE_SIZE || length > IRFRAME_PAYLOAD_MAX) return 0;
+
+    IrFrame* packet = &tx_queue[(tx_head + tx_count) % TX_QUEUE_SIZE];
+    packet->type = packet_type;
+    packet->seq = tx_next_seq;
+    packet->length = length;
+    memcpy (packet->payload, payload, length);
+    tx_next_seq = (tx_next_seq + 1) & SEQ_MASK;
+
+    tx_count++;
+    if(tx_count == 1) ir_comms_start_packet ();
     led_on ();
+    return 1;
 }
 
 // Returns the packet typr received
 uint8_t ir_get_incoming_type (void)
 {
     if(!inbound_ready) return 0;
-    return inbound_packet_type;
+    return inbound.type;
 }
 
-// Reads and returns the data of the received packet
-uint8_t ir_get_incoming_data (void)
+// Returns a byte of the received payload, 0 past the end of it
+uint8_t ir_get_incoming_byte (uint8_t index)
 {
-    if(!inbound_ready) return 0;
-    return inbound_data & DATA_MASK;
+    if(!inbound_ready || index >= inbound.length) return 0;
+    return inbound.payload[index];
 }
 
 // Get coordinate x from packet received
 uint8_t ir_get_incoming_coords_x (void)
 {
-    if(!inbound_ready) return 0;
-    return (uint8_t) (inbound_data >> 3);
+    return ir_get_incoming_byte (0);
 }
 
 // Get coordinate y from packet received
 uint8_t ir_get_incoming_coords_y (void)
 {
-    if(!inbound_ready) return 0;
-    return (uint8_t) (inbound_data & 0x07);
+    return ir_get_incoming_byte (1);
 }
 
-// Reads a boolean from incoming_data
-bool ir_get_incoming_bool (void) {
-    return ((bool) ir_get_incoming_data () & 0x01);
+// Reads a hit/miss response into result, returns false if the received packet isn't one
+bool ir_get_incoming_result (IrShotResult* result)
+{
+    if(ir_get_incoming_type () != PACKET_HITMISS_RESPONSE) return 0;
+    return ir_decode_result (inbound.payload, inbound.length, result);
+}
+
+// Packs the result of a shot into a hit/miss response payload IR_RESULT_LENGTH bytes long
+void ir_encode_result (const IrShotResult* result, uint8_t* payload)
+{
+    uint8_t sunk = 0;
+    if(result->sunk) {
+        sunk = (result->sunk & RESPONSE_SUNK_LENGTH)
+            | ((result->sunk_offset << RESPONSE_SUNK_OFFSET_SHIFT) & RESPONSE_SUNK_OFFSET)
+            | (result->sunk_vertical ? RESPONSE_SUNK_VERTICAL : 0);
+    }
+    payload[0] = result->x;
+    payload[1] = result->y;
+    payload[2] = (result->hit ? RESPONSE_HIT : 0) | (result->game_over ? RESPONSE_GAME_OVER : 0);
+    payload[3] = sunk;
+}
+
+// Unpacks a hit/miss response payload into result, returns false if it is too short
+bool ir_decode_result (const uint8_t* payload, uint8_t length, IrShotResult* result)
+{
+    if(length < IR_RESULT_LENGTH) return 0;
+
+    result->x = payload[0];
+    result->y = payload[1];
+    result->hit = (payload[2] & RESPONSE_HIT) != 0;
+    result->game_over = (payload[2] & RESPONSE_GAME_OVER) != 0;
+    result->sunk = payload[3] & RESPONSE_SUNK_LENGTH;
+    result->sunk_vertical = (payload[3] & RESPONSE_SUNK_VERTICAL) != 0;
+    result->sunk_offset = (payload[3] & RESPONSE_SUNK_OFFSET) >> RESPONSE_SUNK_OFFSET_SHIFT;
+    return 1;
 }
 
 // Sends a hit or miss request with the coordinates x and y
 void ir_send_hit_miss_request (uint8_t x, uint8_t y) {
-    // Byte layout for coords data: (IDxxxyyy)
-    uint8_t coords_data = (x << 3) | (y & 0x07);
-    ir_comms_send (PACKET_HITMISS_REQUEST, coords_data);
+    uint8_t payload[] = {x, y};
+    ir_comms_send (PACKET_HITMISS_REQUEST, payload, sizeof (payload));
 }
 
-// Sends a boolean value, true for a hit and false for a miss
-void ir_send_hit_miss_response (bool has_hit) {
-    // Byte layout for bool data: (ID111111) or (ID000000)
-    uint8_t data_bits = 0x3F;
-    if (!has_hit) data_bits = 0x00;
-    ir_comms_send (PACKET_HITMISS_RESPONSE, data_bits);
+// Sends the result of a shot, everything the other kit needs to finish its turn fits in one frame
+void ir_send_hit_miss_response (const IrShotResult* result) {
+    uint8_t payload[IR_RESULT_LENGTH];
+    ir_encode_result (result, payload);
+    ir_comms_send (PACKET_HITMISS_RESPONSE, payload, sizeof (payload));
 }
 
 // Sends a packet to say that ships have been placed
 void ir_send_ships_placed (void) {
-    ir_comms_send (PACKET_SHIPS_PLACED, 1);
+    ir_comms_send (PACKET_SHIPS_PLACED, NULL, 0);
 }
 
-// Set the variables to 0
+// Set the variables to 0, the next packet can then be accepted
 void ir_clear_inbound_packet (void)
 {
     inbound_ready = 0;
-    inbound_data = 0;
-    inbound_packet_type = 0;
+    inbound_answered = 0;
+    inbound.type = PACKET_NULL;
+    inbound.length = 0;
 }
 
-// Sends an acknowledgment and sets inbound ready to 1
-void ir_send_ack (void)
+// Sets the function that resolves shot requests from the other kit, NULL to leave requests with the sender
+void ir_set_shot_handler (ir_shot_handler_t handler)
 {
+    shot_handler = handler;
+}
+
+// Reads the response already sent for the shot request in the inbound slot, returns false if there wasn't one
+bool ir_get_incoming_answer (IrShotResult* result)
+{
+    if(!inbound_ready || !inbound_answered) return 0;
+    *result = inbound_answer;
+    return 1;
+}
+
+// Puts a packet in the inbound slot for the game, returns false if the slot still holds one.
+// A shot is answered straight away rather than when the game next looks at the inbound slot,
+// the request is still delivered so the game can show the result. Shots are refused until the
+// game sets a handler, so none is answered from a fleet that is still being placed
+static bool ir_comms_accept (const IrFrame* frame)
+{
+    if(inbound_ready) return 0;
+    if(frame->type == PACKET_HITMISS_REQUEST && !shot_handler) return 0;
+
+    inbound = *frame;
     inbound_ready = 1;
-    ir_uart_putc (ACK_BITS);
+
+    if(inbound.type == PACKET_HITMISS_REQUEST && inbound.length >= 2) {
+        shot_handler (inbound.payload[0], inbound.payload[1], &inbound_answer);
+        ir_send_hit_miss_response (&inbound_answer);
+        inbound_answered = 1;
+    }
+    return 1;
+}
+
+// Hands packets sent by this kit to peer instead of sending them over IR, NULL to go back to IR
+void ir_set_local_peer (ir_local_peer_t peer)
+{
+    local_peer = peer;
+}
+
+// Puts a packet from the local peer in the inbound slot as if it had been received, returns false if the slot still holds one
+bool ir_comms_deliver (ir_packet_t packet_type, const uint8_t* payload, uint8_t length)
+{
+    if(length > IRFRAME_PAYLOAD_MAX) return 0;
+
+    IrFrame frame;
+    frame.type = packet_type;
+    frame.seq = 0;
+    frame.length = length;
+    memcpy (frame.payload, payload, length);
+    return ir_comms_accept (&frame);
+}
+
+// True once a hello has been heard from another kit since power up, nonces are never 0
+bool ir_comms_peer_heard (void)
+{
+    return peer_nonce != 0;
+}
+
+// Queues an acknowledgement for the packet with the given sequence number
+static void ir_send_ack (uint8_t seq)
+{
+    ack_pending = 1;
+    ack_seq = seq;
+}
+
+// Handles a frame that arrived with a good CRC. A new packet is only accepted and acknowledged
+// once the game has cleared the last one, until then the sender keeps resending it. Resends of
+// a packet that was already delivered are acknowledged again but not delivered twice
+static void ir_comms_receive (const IrFrame* frame)
+{
+    session_quiet = 0;
+
+    if(frame->type == PACKET_HELLO) return ir_comms_hello (frame);
+
+    // The game is played against the local peer, anything else from over IR is left unanswered
+    if(local_peer) return;
+    if(frame->type == IRBULK_DATA || frame->type == IRBULK_ACK) return ir_bulk_receive (frame);
+
+    if(frame->type == PACKET_ACK) {
+        // Acknowledgement has been received, stop sending the packet it belongs to and move on to the next
+        if(!tx_count || tx_queue[tx_head].seq != frame->seq) return;
+
+        // Only time packets that were sent once, an acknowledgement of a resent packet could belong to any of its sends
+        if(tx_state == TX_WAITING && !tx_retries) ir_comms_rtt_sample (comms_tick);
+        if(tx_state == TX_WAITING) ir_stat_latency (comms_tick);
+        tx_head = (tx_head + 1) % TX_QUEUE_SIZE;
+        tx_count--;
+        if(tx_count) {
+            ir_comms_start_packet ();
+        } else {
+            led_off ();
+        }
+        return;
+    }
+
+    if(frame->seq == rx_last_seq) return ir_send_ack (frame->seq);
+    if(!ir_comms_accept (frame)) return;
+
+    rx_last_seq = frame->seq;
+    ir_send_ack (frame->seq);
+}
+
+// Writes the next byte of the current frame to the UART, or starts the next frame when the wire is free
+// and the frame fits in the time this kit may send. Acknowledgements go before packets so the other kit isn't kept waiting
+static void ir_comms_transmit (void)
+{
+    if(wire_pos < wire_length) {
+        if(!ir_uart_write_ready_p ()) return;
+        ir_uart_putc (wire[wire_pos++]);
+        ir_stat_add (&link_stats.bytes_sent);
+
+        // The timeout runs from the last byte of the head packet
+        if(wire_pos == wire_length && tx_state == TX_SENDING) {
+            tx_state = TX_WAITING;
+            comms_tick = 0;
+        }
+        if(wire_pos == wire_length && wire_bulk_data) ir_bulk_data_sent ();
+        return;
+    }
+
+    // Game packets go before bulk data, which only uses the wire when it is otherwise idle
+    IrFrame frame;
+    uint8_t room = ir_comms_room ();
+    wire_bulk_data = 0;
+    if(ack_pending && IRFRAME_WIRE_BYTES (0) <= room) {
+        IrFrame ack = {PACKET_ACK, ack_seq, 0, {0}};
+        wire_length = irframe_encode (&ack, wire);
+        ack_pending = 0;
+    } else if(hello_pending && IRFRAME_WIRE_BYTES (HELLO_LENGTH) <= room) {
+        ir_comms_pick_nonce ();
+        IrFrame hello = {PACKET_HELLO, 0, HELLO_LENGTH, {session_nonce >> 8, session_nonce, 0, slot_tick}};
+        wire_length = irframe_encode (&hello, wire);
+        hello_pending = 0;
+    } else if(IRFRAME_WIRE_BYTES (1) <= room && ir_bulk_next_ack (&frame)) {
+        wire_length = irframe_encode (&frame, wire);
+    } else if(tx_count && tx_state == TX_DUE && IRFRAME_WIRE_BYTES (tx_queue[tx_head].length) <= room) {
+        wire_length = irframe_encode (&tx_queue[tx_head], wire);
+        tx_state = TX_SENDING;
+    } else if(IRFRAME_BYTES_MAX <= room && ir_bulk_next_data (&frame)) {
+        wire_length = irframe_encode (&frame, wire);
+        wire_bulk_data = 1;
+    } else {
+        return;
+    }
+    wire_pos = 0;
+    backoff = BACKOFF_MIN + ir_comms_random () % BACKOFF_RANGE;
+    ir_stat_add (&link_stats.frames_sent);
 }
 
 // Handles IR packet transmission and acknowledgement
 void ir_comms_tick (void)
 {
-    if(ir_uart_read_ready_p ()) {
-        uint8_t recv_data = (uint8_t) ir_uart_getc ();
-        if(recv_data == ACK_BITS) {
-            // Acknowledgement Packet has been received, stop sending type/data
-            outbound_packet_type_bits = 0;
-            outbound_data_bits = 0;
-            led_off ();
-        } else if((recv_data & ID_MASK) == ID_BITS) {
-            // Type Packet has been received, set inbound packet type
-            inbound_packet_type = (ir_packet_t) (recv_data & TYPE_MASK);
-        } else if(( (recv_data & DATA_ID_MASK) == DATA_ID_BITS) && inbound_packet_type){
-            // Data Packet has been received and packet type received, process inbound data
-            inbound_data = recv_data & DATA_MASK;
-            if (inbound_packet_type == PACKET_HITMISS_RESPONSE) {
-                // Process inbound boolean value
-                uint8_t on_count = 0;
-                uint8_t i = 0;
-                for(i = 0; i < 6; i++) {
-                    on_count += ((inbound_data >> i) & 1);
-                }
-                // Use redundant bits to determine need for retransmission
-                inbound_data = (on_count > 3);
-                if (on_count != 3){
-                    ir_send_ack ();
-                }
-            } else {
-                ir_send_ack ();
-            }
+    // Drain every byte that arrived since the last tick
+    uint8_t head = rx_head;
+    uint8_t tail = rx_tail;
+    while(tail != head) {
+        if(irframe_parse (&parser, rx_buffer[tail & RX_BUFFER_MASK])) {
+            ir_stat_add (&link_stats.frames_received);
+            ir_comms_receive (&parser.frame);
         }
+        ir_stat_add (&link_stats.bytes_received);
+        tail++;
+        line_quiet = 0;
     }
+    rx_tail = tail;
+    if(line_quiet < 255) line_quiet++;
 
-    if(!outbound_packet_type_bits) return;
+    slot_tick = (slot_tick + 1) % SLOT_PERIOD;
 
-    if(comms_tick % 28 == 0) {
-        ir_uart_putc (outbound_packet_type_bits);
-        comms_tick = 0;
-    } else if (comms_tick == 14) {
-        ir_uart_putc (outbound_data_bits);
+    if(session_quiet < SESSION_TIMEOUT) {
+        session_quiet++;
+    } else {
+        ir_comms_session_end ();
     }
 
+    hello_tick--;
+    if(hello_tick == 0) {
+        hello_pending = 1;
+        hello_tick = HELLO_TICKS + ir_comms_random () % (HELLO_TICKS / 4);
+    }
+
+    if(tx_count && tx_state == TX_WAITING && comms_tick >= tx_timeout) {
+        // No acknowledgement in time, send the packet again and wait longer
+        if(tx_retries < 255) tx_retries++;
+        ir_stat_add (&link_stats.retries);
+        tx_timeout = ir_comms_timeout ();
+        tx_state = TX_DUE;
+    }
+
+    ir_comms_transmit ();
+
     comms_tick++;
+    ir_bulk_tick ();
 }
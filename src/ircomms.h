@@ -17,33 +17,119 @@ typedef enum
     PACKET_SHIPS_DESTROYED
 } ir_packet_t;
 
-// Sends data in a packet and turns led on when there is activity using the infared
-void ir_comms_send (ir_packet_t packet_type, uint8_t data);
+// Result of a shot, sent back to the player who fired it
+struct ir_shot_result_s{
+    uint8_t x;
+    uint8_t y;
+    bool hit;
+    bool game_over;         // The player who was shot at has no ships left
+    uint8_t sunk;           // Length of the ship the shot sunk, 0 if none was
+    bool sunk_vertical;     // Orientation of the sunk ship
+    uint8_t sunk_offset;    // Cells from the start of the sunk ship to x, y
+};
+
+typedef struct ir_shot_result_s IrShotResult;
+
+// Resolves a shot at x, y against this kit's fleet and fills in the result
+typedef void (*ir_shot_handler_t) (uint8_t x, uint8_t y, IrShotResult* result);
+
+// Takes a packet sent by this kit when the other player is played on this kit rather than over IR
+typedef void (*ir_local_peer_t) (ir_packet_t packet_type, const uint8_t* payload, uint8_t length);
+
+// Length of a hit/miss response payload
+#define IR_RESULT_LENGTH 4
+
+// Ticks to send one byte at 2400 baud, 10 bits with the start and stop bits
+#define IR_BAUD_RATE 2400
+#define IR_BYTE_TICKS ((10 * IR_TICK_RATE + IR_BAUD_RATE - 1) / IR_BAUD_RATE)
+
+// Acknowledgement latency histogram, the first bucket is under IR_LATENCY_FIRST ticks and each one after is twice as wide
+#define IR_LATENCY_BUCKETS 6
+#define IR_LATENCY_FIRST 16
+
+// Link counters, each stops at 65535
+struct ir_stats_s{
+    uint16_t bytes_sent;
+    uint16_t bytes_received;
+    uint16_t frames_sent;
+    uint16_t frames_received;   // Frames with a good CRC
+    uint16_t retries;           // Packets resent after a timeout
+    uint16_t corrected;         // Codewords with a single bit error that was corrected
+    uint16_t uncorrectable;     // Frames dropped for a codeword with two bit errors
+    uint16_t crc_errors;        // Frames dropped for a bad CRC
+    uint16_t length_errors;     // Frames dropped for a bad length
+    uint16_t dropped;           // Received bytes lost because the receive buffer was full
+    uint16_t session_drops;     // Sessions ended because nothing was heard from the other kit
+    uint16_t latency[IR_LATENCY_BUCKETS];
+};
+
+typedef struct ir_stats_s IrStats;
+
+// Enables the receive interrupt, must be called after ir_uart_init
+void ir_comms_init (void);
+
+// Copies the link counters into stats
+void ir_get_stats (IrStats* stats);
+
+// Clears the link counters
+void ir_clear_stats (void);
+
+// Returns the current retransmission timeout in ticks
+uint16_t ir_get_rto (void);
+
+// Returns the smoothed round trip time in ticks, 0 until a packet has been acknowledged
+uint16_t ir_get_srtt (void);
+
+// Queues a packet with up to IRFRAME_PAYLOAD_MAX bytes of payload and turns led on when there is activity using the infared.
+// Packets are delivered in order, returns false if the queue is full and the packet was not queued
+bool ir_comms_send (ir_packet_t packet_type, const uint8_t* payload, uint8_t length);
 
 // Returns the packet typr received
 uint8_t ir_get_incoming_type (void);
-// Reads and returns the data of the received packet
-uint8_t ir_get_incoming_data (void);
+// Returns a byte of the received payload, 0 past the end of it
+uint8_t ir_get_incoming_byte (uint8_t index);
 
 // Get coordinate x from packet received
 uint8_t ir_get_incoming_coords_x (void);
 // Get coordinate y from packet received
 uint8_t ir_get_incoming_coords_y (void);
 
-// Reads a boolean from incoming_data
-bool ir_get_incoming_bool (void);
+// Reads a hit/miss response into result, returns false if the received packet isn't one
+bool ir_get_incoming_result (IrShotResult* result);
+
+// Packs the result of a shot into a hit/miss response payload IR_RESULT_LENGTH bytes long
+void ir_encode_result (const IrShotResult* result, uint8_t* payload);
+// Unpacks a hit/miss response payload into result, returns false if it is too short
+bool ir_decode_result (const uint8_t* payload, uint8_t length, IrShotResult* result);
 
 // Sends a hit or miss request with the coordinates x and y
 void ir_send_hit_miss_request (uint8_t x, uint8_t y);
-// Sends a boolean value, true for a hit and false for a miss
-void ir_send_hit_miss_response (bool has_hit);
+// Sends the result of a shot, everything the other kit needs to finish its turn fits in one frame
+void ir_send_hit_miss_response (const IrShotResult* result);
 
 // Sends a packet to say that ships have been placed
 void ir_send_ships_placed (void);
 
-// Set the variables to 0
+// Set the variables to 0, the next packet can then be accepted
 void ir_clear_inbound_packet (void);
 
+// Sets the function that resolves shot requests from the other kit, set once this kit's fleet is final.
+// A request is answered as soon as its frame arrives, then delivered as usual. While no function is set
+// requests are left unacknowledged, so the other kit keeps resending them
+void ir_set_shot_handler (ir_shot_handler_t handler);
+
+// Reads the response already sent for the shot request in the inbound slot, returns false if there wasn't one
+bool ir_get_incoming_answer (IrShotResult* result);
+
+// Hands packets sent by this kit to peer instead of sending them over IR, NULL to go back to IR
+void ir_set_local_peer (ir_local_peer_t peer);
+
+// Puts a packet from the local peer in the inbound slot as if it had been received, returns false if the slot still holds one
+bool ir_comms_deliver (ir_packet_t packet_type, const uint8_t* payload, uint8_t length);
+
+// True once a hello has been heard from another kit since power up
+bool ir_comms_peer_heard (void);
+
 // Handles IR packet transmission and acknowledgement
 void ir_comms_tick (void);
 
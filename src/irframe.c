@@ -0,0 +1,166 @@
+/*
+# File:   irframe.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Builds and checks framed IR packets with a sync byte, length and CRC-8
+*/
+
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "system.h"
+#include "irframe.h"
+
+// Extended Hamming(8,4) codewords. Bit n holds code position n: data in positions 3, 5, 6, 7,
+// parity over the positions with bit 0, 1 or 2 set in 1, 2, 4, and parity of the whole word in 0
+#define HAMMING_BIT(D, N) (((D) >> (N)) & 1)
+#define HAMMING_P1(D) (HAMMING_BIT (D, 0) ^ HAMMING_BIT (D, 1) ^ HAMMING_BIT (D, 3))
+#define HAMMING_P2(D) (HAMMING_BIT (D, 0) ^ HAMMING_BIT (D, 2) ^ HAMMING_BIT (D, 3))
+#define HAMMING_P4(D) (HAMMING_BIT (D, 1) ^ HAMMING_BIT (D, 2) ^ HAMMING_BIT (D, 3))
+#define HAMMING_P0(D) (HAMMING_P1 (D) ^ HAMMING_P2 (D) ^ HAMMING_P4 (D) ^ HAMMING_BIT (D, 0) ^ HAMMING_BIT (D, 1) ^ HAMMING_BIT (D, 2) ^ HAMMING_BIT (D, 3))
+#define HAMMING(D) (HAMMING_P0 (D) | (HAMMING_P1 (D) << 1) | (HAMMING_P2 (D) << 2) | (HAMMING_BIT (D, 0) << 3) \
+                    | (HAMMING_P4 (D) << 4) | (HAMMING_BIT (D, 1) << 5) | (HAMMING_BIT (D, 2) << 6) | (HAMMING_BIT (D, 3) << 7))
+
+static const uint8_t hamming_table[16] PROGMEM =
+{
+    HAMMING (0), HAMMING (1), HAMMING (2), HAMMING (3), HAMMING (4), HAMMING (5), HAMMING (6), HAMMING (7),
+    HAMMING (8), HAMMING (9), HAMMING (10), HAMMING (11), HAMMING (12), HAMMING (13), HAMMING (14), HAMMING (15)
+};
+
+// Returned by hamming_decode when a codeword has two bit errors
+#define HAMMING_UNCORRECTABLE 0xFF
+
+enum
+{
+    PARSE_SYNC,
+    PARSE_HEADER,
+    PARSE_LENGTH,
+    PARSE_PAYLOAD,
+    PARSE_CRC
+};
+
+// Decodes a codeword into its nibble, correcting a single bit error. Returns HAMMING_UNCORRECTABLE for two bit errors
+static uint8_t hamming_decode (uint8_t code, bool* corrected)
+{
+    uint8_t syndrome = 0;
+    uint8_t parity = 0;
+    uint8_t pos;
+
+    for(pos = 0; pos < 8; pos++) {
+        if((code >> pos) & 1) {
+            syndrome ^= pos;
+            parity ^= 1;
+        }
+    }
+
+    *corrected = 0;
+    if(parity) {
+        // An odd number of flipped bits, taken to be one. The syndrome is its position, 0 for the overall parity bit
+        code ^= (1 << syndrome);
+        *corrected = 1;
+    } else if(syndrome) {
+        return HAMMING_UNCORRECTABLE;
+    }
+
+    return HAMMING_BIT (code, 3) | (HAMMING_BIT (code, 5) << 1) | (HAMMING_BIT (code, 6) << 2) | (HAMMING_BIT (code, 7) << 3);
+}
+
+// Appends a byte of the frame body as two codewords and adds it to the CRC
+static uint8_t irframe_put (uint8_t* bytes, uint8_t count, uint8_t byte, uint8_t* crc)
+{
+    *crc = _crc8_ccitt_update (*crc, byte);
+    bytes[count++] = pgm_read_byte (&hamming_table[byte & 0x0F]);
+    bytes[count++] = pgm_read_byte (&hamming_table[byte >> 4]);
+    return count;
+}
+
+// Writes a frame into bytes, which must hold IRFRAME_BYTES_MAX bytes. Returns the number of bytes written
+uint8_t irframe_encode (const IrFrame* frame, uint8_t* bytes)
+{
+    uint8_t length = frame->length;
+    if(length > IRFRAME_PAYLOAD_MAX) length = IRFRAME_PAYLOAD_MAX;
+
+    uint8_t crc = 0;
+    uint8_t count = 0;
+    bytes[count++] = IRFRAME_SYNC;
+    count = irframe_put (bytes, count, (frame->type << 4) | (frame->seq & 0x0F), &crc);
+    count = irframe_put (bytes, count, length, &crc);
+
+    uint8_t i;
+    for(i = 0; i < length; i++) {
+        count = irframe_put (bytes, count, frame->payload[i], &crc);
+    }
+
+    return irframe_put (bytes, count, crc, &crc);
+}
+
+// Starts looking for the next sync byte, the error counters are kept
+void irframe_parser_reset (IrFrameParser* parser)
+{
+    parser->state = PARSE_SYNC;
+    parser->pos = 0;
+    parser->crc = 0;
+    parser->low_nibble = 0xFF;
+}
+
+// Passes a received byte to the parser. Returns true when it completes a frame with a good CRC, which is then in parser->frame
+bool irframe_parse (IrFrameParser* parser, uint8_t byte)
+{
+    IrFrame* frame = &parser->frame;
+
+    if(parser->state == PARSE_SYNC) {
+        if(byte == IRFRAME_SYNC) {
+            parser->state = PARSE_HEADER;
+            parser->crc = 0;
+            parser->low_nibble = 0xFF;
+        }
+        return 0;
+    }
+
+    bool corrected;
+    uint8_t nibble = hamming_decode (byte, &corrected);
+    if(nibble == HAMMING_UNCORRECTABLE) {
+        if(parser->uncorrectable < 0xFFFF) parser->uncorrectable++;
+        irframe_parser_reset (parser);
+        return 0;
+    }
+    if(corrected && parser->corrected < 0xFFFF) parser->corrected++;
+
+    // Wait for the high nibble to complete the byte
+    if(parser->low_nibble == 0xFF) {
+        parser->low_nibble = nibble;
+        return 0;
+    }
+    byte = (nibble << 4) | parser->low_nibble;
+    parser->low_nibble = 0xFF;
+
+    if(parser->state == PARSE_CRC) {
+        bool valid = (byte == parser->crc);
+        if(!valid && parser->crc_errors < 0xFFFF) parser->crc_errors++;
+        irframe_parser_reset (parser);
+        return valid;
+    }
+
+    parser->crc = _crc8_ccitt_update (parser->crc, byte);
+
+    if(parser->state == PARSE_HEADER) {
+        frame->type = byte >> 4;
+        frame->seq = byte & 0x0F;
+        parser->state = PARSE_LENGTH;
+
+    } else if(parser->state == PARSE_LENGTH) {
+        if(byte > IRFRAME_PAYLOAD_MAX) {
+            if(parser->length_errors < 0xFFFF) parser->length_errors++;
+            irframe_parser_reset (parser);
+            return 0;
+        }
+        frame->length = byte;
+        parser->pos = 0;
+        parser->state = (byte ? PARSE_PAYLOAD : PARSE_CRC);
+
+    } else {
+        frame->payload[parser->pos++] = byte;
+        if(parser->pos == frame->length) parser->state = PARSE_CRC;
+    }
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+# File:   irframe.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Header file for irframe.c
+*/
+
+#ifndef IRFRAME_H
+#define IRFRAME_H
+
+// Frame layout: [SYNC] [TYPE:4 | SEQ:4] [LENGTH] [PAYLOAD...] [CRC-8]
+// The CRC covers every byte after the sync byte. Each of those bytes is sent as two
+// Hamming(8,4) codewords, low nibble first, so single bit errors are corrected
+#define IRFRAME_SYNC 0x7E
+#define IRFRAME_PAYLOAD_MAX 4
+
+// Bytes on the wire for a frame with the given payload length
+#define IRFRAME_WIRE_BYTES(LENGTH) (1 + 2 * ((LENGTH) + 3))
+#define IRFRAME_BYTES_MAX IRFRAME_WIRE_BYTES (IRFRAME_PAYLOAD_MAX)
+
+struct irframe_s{
+    uint8_t type;       // 0 to 15
+    uint8_t seq;        // 0 to 15
+    uint8_t length;     // Payload bytes used
+    uint8_t payload[IRFRAME_PAYLOAD_MAX];
+};
+
+typedef struct irframe_s IrFrame;
+
+// Receives frames a byte at a time
+struct irframe_parser_s{
+    uint8_t state;
+    uint8_t pos;
+    uint8_t crc;
+    uint8_t low_nibble;     // Low nibble of the byte being received, 0xFF until it has arrived
+    uint16_t corrected;     // Codewords with a single bit error that was corrected
+    uint16_t uncorrectable; // Frames dropped because a codeword had two bit errors
+    uint16_t crc_errors;    // Frames dropped because the CRC did not match
+    uint16_t length_errors; // Frames dropped because the length was too long
+    IrFrame frame;
+};
+
+typedef struct irframe_parser_s IrFrameParser;
+
+// Writes a frame into bytes, which must hold IRFRAME_BYTES_MAX bytes. Returns the number of bytes written
+uint8_t irframe_encode (const IrFrame* frame, uint8_t* bytes);
+
+// Starts looking for the next sync byte, the error counters are kept
+void irframe_parser_reset (IrFrameParser* parser);
+
+// Passes a received byte to the parser. Returns true when it completes a frame with a good CRC, which is then in parser->frame
+bool irframe_parse (IrFrameParser* parser, uint8_t byte);
+
+#endif
@@ -26,42 +26,86 @@ static const pio_t cols[] =
     LEDMAT_COL4_PIO, LEDMAT_COL5_PIO
 };
 
+// Most distinct ports the matrix pins can be spread across (PORTB, PORTC and PORTD)
+#define LEDMAT_PORTS_MAX 3
+
+// Port registers used by the matrix, with the mask that drives all of their matrix pins high
+static volatile uint8_t *ports[LEDMAT_PORTS_MAX];
+static uint8_t port_off_masks[LEDMAT_PORTS_MAX];
+static uint8_t ports_num = 0;
+
+// Port table index and bitmask of every row and column pin, worked out once at init
+static uint8_t row_ports[LEDMAT_ROWS_NUM];
+static uint8_t row_masks[LEDMAT_ROWS_NUM];
+static uint8_t col_ports[LEDMAT_COLS_NUM];
+static uint8_t col_masks[LEDMAT_COLS_NUM];
+
 static bool display_inverted = 0;
 
+// Returns the port table index for a pin, adding its port to the table if it is new
+static uint8_t ledmatrix_port_index (pio_t pio)
+{
+    volatile uint8_t *port = &PIO_PORT_ (pio);
+    uint8_t i;
+
+    for (i = 0; i < ports_num; i++) {
+        if (ports[i] == port) return i;
+    }
+
+    ports[ports_num] = port;
+    port_off_masks[ports_num] = 0;
+    return ports_num++;
+}
+
 void ledmatrix_init (void)
 {
+    ports_num = 0;
+
     int row;
     for (row = 0; row < LEDMAT_ROWS_NUM; row++) {
         pio_config_set (rows[row], PIO_OUTPUT_HIGH);
+        row_ports[row] = ledmatrix_port_index (rows[row]);
+        row_masks[row] = PIO_BITMASK_ (rows[row]);
+        port_off_masks[row_ports[row]] |= row_masks[row];
     }
 
     int col;
     for (col = 0; col < LEDMAT_COLS_NUM; col++) {
         pio_config_set (cols[col], PIO_OUTPUT_HIGH);
+        col_ports[col] = ledmatrix_port_index (cols[col]);
+        col_masks[col] = PIO_BITMASK_ (cols[col]);
+        port_off_masks[col_ports[col]] |= col_masks[col];
     }
 }
 
+// Pins are already configured as outputs by ledmatrix_init, so a column is switched by writing
+// the port registers directly rather than going through pio_config_set for every pin
 void display_column (uint8_t row_pattern, uint8_t current_column)
 {
+    uint8_t row_low[LEDMAT_PORTS_MAX] = {0, };
     uint8_t current_row = 0;
-    static int last_column = 0;
+    uint8_t i;
+    static uint8_t last_column = 0;
 
     if(display_inverted) {
         row_pattern = ~row_pattern;
     }
 
-    pio_config_set(cols[last_column], PIO_OUTPUT_HIGH);
-
-    while (current_row < 7) {
+    while (current_row < LEDMAT_ROWS_NUM) {
         if ((row_pattern >> current_row) & 1) {
-            pio_config_set(rows[current_row], PIO_OUTPUT_LOW);
-        } else {
-            pio_config_set(rows[current_row], PIO_OUTPUT_HIGH);
+            row_low[row_ports[current_row]] |= row_masks[current_row];
         }
         current_row++;
     }
 
-    pio_config_set(cols[current_column], PIO_OUTPUT_LOW);
+    // Switch the old column off first so it never shows the new row pattern
+    *ports[col_ports[last_column]] |= col_masks[last_column];
+
+    for (i = 0; i < ports_num; i++) {
+        *ports[i] = (*ports[i] | port_off_masks[i]) & ~row_low[i];
+    }
+
+    *ports[col_ports[current_column]] &= ~col_masks[current_column];
     last_column = current_column;
 }
 
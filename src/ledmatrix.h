@@ -8,10 +8,12 @@
 #ifndef LEDMATRIX_H
 #define LEDMATRIX_H
 
-#define LUMINANCE_STEPS 4
-#define PWM_RATE 256
-#define UPDATE_RATE (LUMINANCE_STEPS * PWM_RATE)
-#define LOOP_RATE (7 * UPDATE_RATE)
+// Brightest pixel intensity, giving 16 gamma corrected levels including off
+#define LUMINANCE_STEPS 15
+// Binary code modulation bitplanes shown per column, more gives finer steps between dim levels
+#define LUMINANCE_DEPTH 6
+// Timer1 counts the least significant bitplane is shown for, each further plane doubles it
+#define LUMINANCE_UNIT 32
 
 void ledmatrix_init (void);
 
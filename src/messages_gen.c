@@ -0,0 +1,96 @@
+/*
+# File:   messages_gen.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   18 Oct 2017
+# Descr:  Host program that renders the text in messages.def into column strips kept in flash
+*/
+
+#include <stdio.h>
+#include <ctype.h>
+#include "font.h"
+#include "font3x5_1.h"
+
+struct message_s {
+    const char* name;
+    const char* text;
+};
+
+static const struct message_s messages[] =
+{
+#define MESSAGE(NAME, TEXT) {#NAME, TEXT},
+#include "messages.def"
+#undef MESSAGE
+};
+
+#define MESSAGES_COUNT (sizeof (messages) / sizeof (messages[0]))
+
+// Writes the columns of a message in the same layout as bitmap_render_font,
+// bit y set for each lit pixel and a blank column after every character. Returns the column count
+static int message_columns_write (FILE* out, const char* text)
+{
+    int cols = 0;
+    uint8_t x;
+    uint8_t y;
+
+    while (*text != '\0') {
+        char ch = toupper (*text);
+        for (x = 0; x < FONT_WIDTH; x++) {
+            uint8_t column = 0;
+            for (y = 0; y < FONT_HEIGHT; y++) {
+                if (font_pixel_get (&font3x5_1, ch, x, FONT_HEIGHT - 1 - y)) column |= 1 << y;
+            }
+            fprintf (out, "0x%02x, ", column);
+            cols++;
+        }
+        fprintf (out, "0x00,\n    ");
+        cols++;
+        text++;
+    }
+    return cols;
+}
+
+int main (int argc, char** argv)
+{
+    FILE* header;
+    FILE* source;
+    unsigned int i;
+    int offset = 0;
+
+    if (argc != 3) {
+        fprintf (stderr, "usage: %s messages.h messages.c\n", argv[0]);
+        return 1;
+    }
+
+    header = fopen (argv[1], "w");
+    source = fopen (argv[2], "w");
+    if (!header || !source) {
+        perror ("messages_gen");
+        return 1;
+    }
+
+    fprintf (source, "/* Generated by messages_gen from messages.def, do not edit.  */\n\n");
+    fprintf (source, "#include \"system.h\"\n#include \"messages.h\"\n\n");
+    fprintf (source, "const uint8_t message_strips[] PROGMEM =\n{\n    ");
+
+    fprintf (header, "/* Generated by messages_gen from messages.def, do not edit.  */\n\n");
+    fprintf (header, "#ifndef MESSAGES_H\n#define MESSAGES_H\n\n");
+    fprintf (header, "#include <avr/pgmspace.h>\n#include \"bitmap.h\"\n\n");
+    fprintf (header, "extern const uint8_t message_strips[] PROGMEM;\n\n");
+
+    for (i = 0; i < MESSAGES_COUNT; i++) {
+        int cols = message_columns_write (source, messages[i].text);
+
+        fprintf (header, "// \"%s\"\n", messages[i].text);
+        fprintf (header, "#define MSG_%s ((bitmap_strip_t) {message_strips + %d, %d})\n",
+                 messages[i].name, offset, cols);
+        fprintf (header, "#define MSG_%s_TICKS BITMAP_STRIP_TICKS (%d)\n\n", messages[i].name, cols);
+        offset += cols;
+    }
+
+    fprintf (source, "\n};\n");
+    fprintf (header, "#endif\n");
+
+    fclose (header);
+    fclose (source);
+    return 0;
+}
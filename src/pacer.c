@@ -2,28 +2,80 @@
 # File:   pacer.c
 # Author: Alexander Miller, Mark Arunchayanon
 # Date:   16 Oct 2017
-# Descr:  Determines te number of ticks for the input frequency
+# Descr:  Paces the main loop from Timer1 compare interrupts, sleeping between ticks
 */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "system.h"
 #include "pacer.h"
 
 static uint16_t pacer_period;
+static uint16_t pacer_idle;
+static volatile uint8_t pacer_ticks = 0;
+
+// Schedules the next tick from the last compare match rather than from when the loop
+// got round to waiting, so the pacer never drifts
+ISR (TIMER1_COMPA_vect)
+{
+    OCR1A += pacer_period;
+    if (pacer_ticks < 255) pacer_ticks++;
+}
 
 // Initialise the pacer module
 void pacer_init (uint16_t pacer_frequency)
 {
-    TCNT1 = 0;
+    // Timer1 free runs at PACER_TIMER_RATE, it is never reset so the display
+    // refresh can share it through the compare B interrupt
     TCCR1A = 0x00;
-    TCCR1B = 0x05;
+    TCCR1B = 0x02;
     TCCR1C = 0x00;
-    pacer_period = (uint16_t) (1000 * (1 / (float) pacer_frequency) / 0.128);
+    pacer_period = PACER_TIMER_RATE / pacer_frequency;
+
+    OCR1A = TCNT1 + pacer_period;
+    TIFR1 = (1 << OCF1A);
+    TIMSK1 |= (1 << OCIE1A);
+
+    set_sleep_mode (SLEEP_MODE_IDLE);
+}
+
+
+// Sleeps until the next tick and returns the number of ticks since the last call.
+// If the loop overran, ticks are already due and this returns straight away with more than 1
+uint8_t pacer_wait (void)
+{
+    uint16_t start = TCNT1;
+    uint8_t ticks;
+
+    // Interrupts stay off from checking pacer_ticks until the cpu sleeps, sei only takes
+    // effect after the following instruction so the tick can't slip in between
+    cli ();
+    while (!pacer_ticks) {
+        sleep_enable ();
+        sei ();
+        sleep_cpu ();
+        sleep_disable ();
+        cli ();
+    }
+    ticks = pacer_ticks;
+    pacer_ticks = 0;
+    sei ();
+
+    pacer_idle = TCNT1 - start;
+    return ticks;
+}
+
+
+// Timer counts spent waiting in the last call to pacer_wait
+uint16_t pacer_get_idle (void)
+{
+    return pacer_idle;
 }
 
 
-// Waits until the remaining pacer_period is up
-void pacer_wait (void)
+// Timer counts in each pacer period
+uint16_t pacer_get_period (void)
 {
-    while(TCNT1 < pacer_period);
-    TCNT1 = 0;
+    return pacer_period;
 }
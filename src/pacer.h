@@ -8,11 +8,23 @@
 #ifndef PACER_H
 #define PACER_H
 
+// Timer1 count rate, the clock divided by 8
+#define PACER_TIMER_RATE (F_CPU / 8)
+
 /* Initialise the pacer module.  */
 void pacer_init (uint16_t pacer_frequency);
 
 
-/* Pace a while loop.  */
-void pacer_wait (void);
+/* Pace a while loop, sleeping until the next tick.  Returns the
+   number of ticks since the last call, more than 1 if the loop overran.  */
+uint8_t pacer_wait (void);
+
+
+/* Timer counts spent waiting in the last call to pacer_wait.  */
+uint16_t pacer_get_idle (void);
+
+
+/* Timer counts in each pacer period.  */
+uint16_t pacer_get_period (void);
 
 #endif //PACER_H
@@ -0,0 +1,154 @@
+/*
+# File:   profile.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   19 Oct 2017
+# Descr:  Keeps timings of each stage of the main loop and shows them on a debug screen.
+#         Only built into the firmware with "make PROFILE=1"
+*/
+
+#include "system.h"
+#include "pacer.h"
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include <util/atomic.h>
+#include "bitmap.h"
+#include "ledmatrix.h"
+#include "navswitch.h"
+#include "debug.h"
+
+struct profile_stat_s{
+    uint16_t min;
+    uint16_t max;
+    uint32_t total;
+    uint16_t count;
+    uint16_t overruns;
+};
+
+typedef struct profile_stat_s ProfileStat;
+
+static ProfileStat stats[PROFILE_STAGES_NUM];
+
+// The debug screen has a page for each stage, then one for each scheduler task's missed deadlines
+#define PROFILE_PAGES_NUM (PROFILE_STAGES_NUM + SCHEDULER_TASKS_MAX)
+
+// Page shown on the debug screen and the text for it
+static uint8_t debug_page = 0;
+static char debug_text[32];
+static int debug_ticks = 0;
+
+// Adds a value to a stage's min/avg/max
+static void profile_add (ProfileStat* stat, uint16_t counts)
+{
+    // Start the average again rather than let it overflow
+    if (stat->count == 0xFFFF) {
+        stat->total = 0;
+        stat->count = 0;
+    }
+
+    if (stat->count == 0 || counts < stat->min) stat->min = counts;
+    if (counts > stat->max) stat->max = counts;
+    stat->total += counts;
+    stat->count++;
+}
+
+// Adds a timing to a stage, counting an overrun if it took longer than the stage's budget.
+// The refresh interrupt has to finish within its shortest bitplane, everything else within a pacer tick
+void profile_record (uint8_t stage, uint16_t counts)
+{
+    uint16_t budget = (stage == PROFILE_DISPLAY ? LUMINANCE_UNIT : pacer_get_period ());
+
+    if (stage >= PROFILE_STAGES_NUM) return;
+
+    profile_add (&stats[stage], counts);
+    if (counts > budget) stats[stage].overruns++;
+}
+
+// Records the pacer's idle time and any ticks missed since the last wait
+void profile_record_loop (uint8_t ticks)
+{
+    profile_add (&stats[PROFILE_IDLE], pacer_get_idle ());
+    stats[PROFILE_IDLE].overruns += ticks - 1;
+}
+
+// Formats the text for a stage from pos, as "<name> <min> <avg> <max> <overruns> ", returns the position after it
+static uint8_t profile_format_stage (uint8_t stage, uint8_t pos)
+{
+    ProfileStat stat;
+
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+        stat = stats[stage];
+    }
+
+    // Stages are named I(dle), D(isplay), A(i), T(ask) n and S(tate) n. There are more than ten states,
+    // so n is written as a number and the space after it is taken back to be added below
+    if (stage == PROFILE_IDLE) {
+        debug_text[pos++] = 'I';
+    } else if (stage == PROFILE_DISPLAY) {
+        debug_text[pos++] = 'D';
+    } else if (stage == PROFILE_AI) {
+        debug_text[pos++] = 'A';
+    } else if (stage < PROFILE_STATES) {
+        debug_text[pos++] = 'T';
+        pos = debug_format_number (debug_text, pos, stage - PROFILE_TASKS) - 1;
+    } else {
+        debug_text[pos++] = 'S';
+        pos = debug_format_number (debug_text, pos, stage - PROFILE_STATES) - 1;
+    }
+    debug_text[pos++] = ' ';
+
+    pos = debug_format_number (debug_text, pos, (uint32_t) stat.min * PROFILE_CYCLES_PER_COUNT);
+    pos = debug_format_number (debug_text, pos, (stat.count ? stat.total / stat.count : 0) * PROFILE_CYCLES_PER_COUNT);
+    pos = debug_format_number (debug_text, pos, (uint32_t) stat.max * PROFILE_CYCLES_PER_COUNT);
+    return debug_format_number (debug_text, pos, stat.overruns);
+}
+
+// Formats the debug screen text for the current page. A task's missed deadlines show as "M<n> <missed>"
+static void profile_format_page (void)
+{
+    uint8_t pos = 0;
+
+    if (debug_page < PROFILE_STAGES_NUM) {
+        pos = profile_format_stage (debug_page, pos);
+    } else {
+        debug_text[pos++] = 'M';
+        pos = debug_format_number (debug_text, pos, debug_page - PROFILE_STAGES_NUM);
+        pos = debug_format_number (debug_text, pos, scheduler_get_missed (debug_page - PROFILE_STAGES_NUM));
+    }
+    debug_text[pos - 1] = '\0';
+
+    bitmap_reset_font_scroll ();
+    debug_ticks = bitmap_get_font_ticks (debug_text);
+}
+
+// Formats the first page to show when the profiler debug state is entered
+void state_debug_profile_enter (void)
+{
+    profile_format_page ();
+}
+
+// Scrolls the min/avg/max time and overruns of one stage in cycles, or the missed deadlines of one task.
+// Left and right pick the page, push restarts the game
+void state_debug_profile_tick (void)
+{
+    if (navswitch_push_event_p (NAVSWITCH_PUSH)) {
+        return game_init ();
+    }
+
+    if (navswitch_push_event_p (NAVSWITCH_EAST)) {
+        debug_page = (debug_page + 1) % PROFILE_PAGES_NUM;
+        profile_format_page ();
+    } else if (navswitch_push_event_p (NAVSWITCH_WEST)) {
+        debug_page = (debug_page == 0 ? PROFILE_PAGES_NUM - 1 : debug_page - 1);
+        profile_format_page ();
+    }
+
+    bitmap_render_font (debug_text, 0, 0, BITMAP_ALIGN_LEFT, 1);
+
+    // Pick up the latest figures each time the text has scrolled past
+    debug_ticks--;
+    if (debug_ticks == 0) profile_format_page ();
+}
+
+#endif
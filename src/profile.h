@@ -0,0 +1,58 @@
+/*
+# File:   profile.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   19 Oct 2017
+# Descr:  Header file for profile.c. Everything here compiles to nothing unless PROFILE is defined
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "scheduler.h"
+#include "game.h"
+
+// Stages of the main loop that get timed
+typedef enum
+{
+    PROFILE_IDLE,                                       // Time the pacer slept, overruns are loop ticks missed
+    PROFILE_DISPLAY,                                    // Display refresh interrupt
+    PROFILE_AI,                                         // Computer opponent's map updates and choice of shot
+    PROFILE_TASKS,                                      // Scheduler tasks, in the order they were added
+    PROFILE_STATES = PROFILE_TASKS + SCHEDULER_TASKS_MAX,   // Game state ticks, by game_state_t
+    PROFILE_STAGES_NUM = PROFILE_STATES + GAME_STATES_NUM
+} profile_stage_t;
+
+#ifdef PROFILE
+
+// Cpu cycles in each timer count, stage times are kept in timer counts
+#define PROFILE_CYCLES_PER_COUNT (F_CPU / PACER_TIMER_RATE)
+
+// Starts timing a stage, VAR holds the start time
+#define PROFILE_BEGIN(VAR) uint16_t VAR = TCNT1
+// Adds the time since PROFILE_BEGIN to a stage
+#define PROFILE_END(STAGE, VAR) profile_record ((STAGE), TCNT1 - (VAR))
+// Records the pacer's idle time and any ticks missed since the last wait
+#define PROFILE_LOOP(TICKS) profile_record_loop (TICKS)
+
+// Adds a timing to a stage, counting an overrun if it took longer than the stage's budget
+void profile_record (uint8_t stage, uint16_t counts);
+
+// Records the pacer's idle time and any ticks missed since the last wait
+void profile_record_loop (uint8_t ticks);
+
+// Formats the first page to show when the profiler debug state is entered
+void state_debug_profile_enter (void);
+
+// Scrolls the min/avg/max time and overruns of one stage in cycles, or the missed deadlines of one task.
+// Left and right pick the page, push restarts the game
+void state_debug_profile_tick (void);
+
+#else
+
+#define PROFILE_BEGIN(VAR)
+#define PROFILE_END(STAGE, VAR)
+#define PROFILE_LOOP(TICKS)
+
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/*
+# File:   scheduler.c
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   19 Oct 2017
+# Descr:  Runs each subsystem at its own rate from the pacer tick
+*/
+
+#include "system.h"
+#include "pacer.h"
+#include "scheduler.h"
+#include "profile.h"
+
+struct task_s{
+    void (*func) (void);
+    uint16_t period;    // Scheduler ticks between runs
+    uint16_t due;       // Tick the task next runs on
+    uint16_t missed;    // Runs started after the deadline
+};
+
+typedef struct task_s SchedulerTask;
+
+static SchedulerTask tasks[SCHEDULER_TASKS_MAX];
+static uint8_t tasks_num = 0;
+
+// Registers a task to run rate times per second, tasks due on the same tick run in the order they were added
+void scheduler_add (void (*func) (void), uint16_t rate)
+{
+    if (tasks_num >= SCHEDULER_TASKS_MAX) return;
+
+    tasks[tasks_num].func = func;
+    tasks[tasks_num].period = SCHEDULER_RATE / rate;
+    tasks[tasks_num].due = 0;
+    tasks[tasks_num].missed = 0;
+    tasks_num++;
+}
+
+// Runs the registered tasks forever, call after pacer_init (SCHEDULER_RATE)
+void scheduler_run (void)
+{
+    uint16_t now = 0;
+    uint8_t ticks;
+    uint8_t i;
+
+    while (1) {
+        // Ticks the pacer went through while the last tasks were running still count
+        ticks = pacer_wait ();
+        now += ticks;
+        PROFILE_LOOP (ticks);
+
+        for (i = 0; i < tasks_num; i++) {
+            SchedulerTask* task = &tasks[i];
+            uint16_t late = now - task->due;
+
+            if ((int16_t) late < 0) continue;
+
+            // Run once and start again from now rather than running a backlog of missed periods
+            if (late >= task->period) {
+                task->missed++;
+                task->due = now;
+            }
+            task->due += task->period;
+
+            PROFILE_BEGIN (start);
+            task->func ();
+            PROFILE_END (PROFILE_TASKS + i, start);
+        }
+    }
+}
+
+// Number of times a task started after its deadline, the end of the period it was due in
+uint16_t scheduler_get_missed (uint8_t task)
+{
+    if (task >= tasks_num) return 0;
+    return tasks[task].missed;
+}
@@ -0,0 +1,26 @@
+/*
+# File:   scheduler.h
+# Author: Alexander Miller, Mark Arunchayanon
+# Date:   19 Oct 2017
+# Descr:  Header file for scheduler.c
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Scheduler ticks per second, task rates must divide into this
+#define SCHEDULER_RATE 1000
+
+// Most tasks that can be registered
+#define SCHEDULER_TASKS_MAX 6
+
+// Registers a task to run rate times per second, tasks due on the same tick run in the order they were added
+void scheduler_add (void (*func) (void), uint16_t rate);
+
+// Runs the registered tasks forever, call after pacer_init (SCHEDULER_RATE)
+void scheduler_run (void);
+
+// Number of times a task started after its deadline, the end of the period it was due in
+uint16_t scheduler_get_missed (uint8_t task);
+
+#endif